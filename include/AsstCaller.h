@@ -48,6 +48,8 @@ extern "C"
     AsstSize ASSTAPI AsstGetImage(AsstHandle handle, void* buff, AsstSize buff_size);
     AsstSize ASSTAPI AsstGetUUID(AsstHandle handle, char* buff, AsstSize buff_size);
     AsstSize ASSTAPI AsstGetTasksList(AsstHandle handle, AsstTaskId* buff, AsstSize buff_size);
+    /* 截图、输入各阶段的耗时分布，json 字符串，不带结尾的 '\0' */
+    AsstSize ASSTAPI AsstGetLatencyStats(AsstHandle handle, char* buff, AsstSize buff_size);
     AsstSize ASSTAPI AsstGetNullSize();
 
     ASSTAPI_PORT const char* ASST_CALL AsstGetVersion();
@@ -5,6 +5,7 @@
 #include <meojson/json.hpp>
 
 #include "Config/GeneralConfig.h"
+#include "Config/Miscellaneous/TaskHitStats.h"
 #include "Config/Miscellaneous/OcrPack.h"
 #include "Controller.h"
 #include "Status.h"
@@ -64,6 +65,8 @@ Assistant::~Assistant()
     if (m_msg_thread.joinable()) {
         m_msg_thread.join();
     }
+    // 不满 SaveInterval 次的统计还没写进文件
+    TaskHitStats::get_instance().save();
 }
 
 bool asst::Assistant::set_instance_option(InstanceOptionKey key, const std::string& value)
@@ -94,6 +97,36 @@ bool asst::Assistant::set_instance_option(InstanceOptionKey key, const std::stri
             return true;
         }
         break;
+    case InstanceOptionKey::ScreencapPrefetch:
+        if (constexpr std::string_view Enable = "1"; value == Enable) {
+            m_ctrler->set_screencap_prefetch(true);
+            return true;
+        }
+        else if (constexpr std::string_view Disable = "0"; value == Disable) {
+            m_ctrler->set_screencap_prefetch(false);
+            return true;
+        }
+        break;
+    case InstanceOptionKey::ParallelRecognition:
+        if (constexpr std::string_view Enable = "1"; value == Enable) {
+            m_parallel_recognition = true;
+            return true;
+        }
+        else if (constexpr std::string_view Disable = "0"; value == Disable) {
+            m_parallel_recognition = false;
+            return true;
+        }
+        break;
+    case InstanceOptionKey::AdaptiveTaskOrder:
+        if (constexpr std::string_view Enable = "1"; value == Enable) {
+            m_adaptive_task_order = true;
+            return true;
+        }
+        else if (constexpr std::string_view Disable = "0"; value == Disable) {
+            m_adaptive_task_order = false;
+            return true;
+        }
+        break;
     }
     Log.error("Unknown key or value", value);
     return false;
@@ -266,6 +299,11 @@ std::vector<Assistant::TaskId> asst::Assistant::get_tasks_list() const
     return result;
 }
 
+std::string asst::Assistant::get_latency_stats() const
+{
+    return m_ctrler->get_latency_stats().to_string();
+}
+
 bool asst::Assistant::start(bool block)
 {
     LogTraceFunction;
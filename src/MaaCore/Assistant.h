@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
 #include <future>
 #include <list>
@@ -52,6 +53,8 @@ public:
     virtual std::string get_uuid() const = 0;
     // 获取任务列表
     virtual std::vector<TaskId> get_tasks_list() const = 0;
+    // 获取截图、输入各阶段的耗时分布（json）
+    virtual std::string get_latency_stats() const = 0;
 };
 
 namespace asst
@@ -85,11 +88,14 @@ namespace asst
         virtual std::vector<unsigned char> get_image() const override;
         virtual std::string get_uuid() const override;
         virtual std::vector<TaskId> get_tasks_list() const override;
+        virtual std::string get_latency_stats() const override;
 
     public:
         std::shared_ptr<Controller> ctrler() const { return m_ctrler; }
         std::shared_ptr<Status> status() const { return m_status; }
         bool need_exit() const { return m_thread_idle; }
+        bool parallel_recognition() const { return m_parallel_recognition; }
+        bool adaptive_task_order() const { return m_adaptive_task_order; }
 
     private:
         void working_proc();
@@ -113,6 +119,8 @@ namespace asst
         void* m_callback_arg = nullptr;
 
         bool m_thread_idle = true;
+        std::atomic_bool m_parallel_recognition = false;
+        std::atomic_bool m_adaptive_task_order = false;
         mutable std::mutex m_mutex;
         std::condition_variable m_condvar;
 
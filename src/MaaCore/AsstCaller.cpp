@@ -226,6 +226,20 @@ AsstSize AsstGetTasksList(AsstHandle handle, AsstTaskId* buff, AsstSize buff_siz
     return data_size;
 }
 
+AsstSize AsstGetLatencyStats(AsstHandle handle, char* buff, AsstSize buff_size)
+{
+    if (!inited() || handle == nullptr || buff == nullptr) {
+        return NullSize;
+    }
+    auto stats = handle->get_latency_stats();
+    size_t data_size = stats.size();
+    if (buff_size < data_size) {
+        return NullSize;
+    }
+    memcpy(buff, stats.data(), data_size * sizeof(decltype(stats)::value_type));
+    return data_size;
+}
+
 AsstSize AsstGetNullSize()
 {
     return NullSize;
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <array>
 #include <climits>
 #include <cmath>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <ostream>
+#include <regex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -40,6 +44,9 @@ namespace asst
         /* Deprecated */         // MinitouchEnabled = 1,
         TouchMode = 2,           // 触控模式设置， "minitouch" | "maatouch" | "adb"
         DeploymentWithPause = 3, // 自动战斗、肉鸽、保全 是否使用 暂停下干员， "0" | "1"
+        ScreencapPrefetch = 4,   // 是否在后台线程持续截图，"0" | "1"
+        ParallelRecognition = 5, // 识别时多个模板候选是否并行匹配，"0" | "1"
+        AdaptiveTaskOrder = 6,   // 是否按命中统计调整 next 候选的识别顺序，"0" | "1"
     };
 
     struct Point
@@ -363,8 +370,18 @@ namespace asst
                             // 即识别到了res，点击res + result_move的位置
         bool cache = false; // 是否使用缓存区域
         std::vector<int> special_params; // 某些任务会用到的特殊参数
+        bool adaptive_order = false;     // next 里的候选没有先后关系，可以按命中率调整识别顺序
     };
 
+    // ocrReplace 里的一条替换规则，加载任务时编译好，识别时不用每次再构造 std::regex
+    struct OcrReplaceRule
+    {
+        std::string pattern;
+        std::string replacement;
+        std::shared_ptr<const std::regex> regex; // 不含正则元字符的纯文本规则为空，直接按子串替换
+    };
+    using OcrReplaceRules = std::vector<OcrReplaceRule>;
+
     // 文字识别任务的信息
     struct OcrTaskInfo : public TaskInfo
     {
@@ -378,8 +395,7 @@ namespace asst
         bool full_match = false;       // 是否需要全匹配，否则搜索到子串就算匹配上了
         bool is_ascii = false;         // 是否启用字符数字模型
         bool without_det = false;      // 是否不使用检测模型
-        std::unordered_map<std::string, std::string>
-            replace_map; // 部分文字容易识别错，字符串强制replace之后，再进行匹配
+        OcrReplaceRules replace_rules; // 部分文字容易识别错，字符串强制replace之后，再进行匹配
     };
 
     // 图片匹配任务的信息
@@ -394,8 +410,13 @@ namespace asst
         std::string templ_name;         // 匹配模板图片文件名
         double templ_threshold = 0;     // 模板匹配阈值
         std::pair<int, int> mask_range; // 掩码的二值化范围
+        int pyramid_level = 0;          // 金字塔粗匹配的层数，0 为不启用，1 为 1/2 分辨率，2 为 1/4
     };
 
+    // 缩放到 16x16 再二值化得到的感知哈希，按行优先，每个 uint64_t 放 4 行，高位在前。
+    // 写成文本时是 64 位的十六进制字符串，见 HashImageAnalyzer::to_hex
+    using ImageHash = std::array<uint64_t, 4>;
+
     // hash 计算任务的信息
     struct HashTaskInfo : public TaskInfo
     {
@@ -60,6 +60,16 @@ bool asst::GeneralConfig::parse(const json::value& json)
         adb.chmod_minitouch = cfg_json.get("chmodMinitouch", base_cfg.chmod_minitouch);
         adb.call_minitouch = cfg_json.get("callMinitouch", base_cfg.call_minitouch);
         adb.call_maatouch = cfg_json.get("callMaatouch", base_cfg.call_maatouch);
+        adb.shell_session = cfg_json.get("shellSession", base_cfg.shell_session);
+        adb.adb_server = cfg_json.get("adbServer", base_cfg.adb_server);
+        adb.screencap_raw_by_adb_protocol =
+            cfg_json.get("screencapRawByAdbProtocol", base_cfg.screencap_raw_by_adb_protocol);
+        adb.screencap_shared_memory = cfg_json.get("screencapSharedMemory", base_cfg.screencap_shared_memory);
+        adb.push_stream_emitter = cfg_json.get("pushStreamEmitter", base_cfg.push_stream_emitter);
+        adb.chmod_stream_emitter = cfg_json.get("chmodStreamEmitter", base_cfg.chmod_stream_emitter);
+        adb.call_stream_emitter = cfg_json.get("callStreamEmitter", base_cfg.call_stream_emitter);
+        adb.forward_stream = cfg_json.get("forwardStream", base_cfg.forward_stream);
+        adb.remove_forward_stream = cfg_json.get("removeForwardStream", base_cfg.remove_forward_stream);
 
         m_adb_cfg[cfg_json.at("configName").as_string()] = std::move(adb);
     }
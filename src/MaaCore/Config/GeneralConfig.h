@@ -74,6 +74,15 @@ namespace asst
         std::string chmod_minitouch;
         std::string call_minitouch;
         std::string call_maatouch;
+        std::string shell_session;
+        std::string adb_server;
+        std::string screencap_raw_by_adb_protocol;
+        std::string screencap_shared_memory; // 本机截图 agent 的共享内存名
+        std::string push_stream_emitter;
+        std::string chmod_stream_emitter;
+        std::string call_stream_emitter;
+        std::string forward_stream;        // 输出 adb forward 分到的本机端口
+        std::string remove_forward_stream;
     };
 
     class GeneralConfig final : public SingletonHolder<GeneralConfig>, public AbstractConfig
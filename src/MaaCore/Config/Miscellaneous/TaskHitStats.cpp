@@ -0,0 +1,172 @@
+#include "TaskHitStats.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <meojson/json.hpp>
+
+#include "Config/TaskData.h"
+#include "Utils/Logger.hpp"
+
+bool asst::TaskHitStats::load(const std::filesystem::path& path)
+{
+    LogTraceFunction;
+    Log.info("load", path);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // 加载外服资源时会再走一遍，还是同一个文件，别把没存下来的统计清掉
+    if (path == m_path) {
+        return true;
+    }
+    m_path = path;
+    m_stats.clear();
+
+    if (!std::filesystem::exists(path)) {
+        return true;
+    }
+    auto json_opt = json::open(path);
+    if (!json_opt || !json_opt->is_object()) {
+        Log.warn("invalid task hit stats, ignored", path);
+        return true;
+    }
+    for (const auto& [pre_task, stats_json] : json_opt->as_object()) {
+        PreTaskStats& stats = m_stats[pre_task];
+        stats.total = stats_json.get("total", 0ULL);
+        if (auto hits_opt = stats_json.find<json::object>("hits")) {
+            for (const auto& [name, hits] : *hits_opt) {
+                stats.hits.emplace(name, hits.as_unsigned_long_long());
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<std::string> asst::TaskHitStats::reorder(const std::string& pre_task,
+                                                     const std::vector<std::string>& tasks_name) const
+{
+    // 最开始的任务列表是代码里直接给的，不知道有没有先后关系，不动
+    if (pre_task.empty() || tasks_name.size() < 2) {
+        return tasks_name;
+    }
+    if (auto pre_task_ptr = Task.get(pre_task); !pre_task_ptr || !pre_task_ptr->adaptive_order) {
+        return tasks_name;
+    }
+
+    // 识别一次的大致开销，只用来比大小。返回 0 的是分界，不会跟别的调换
+    auto cost_of = [](const std::shared_ptr<TaskInfo>& task_ptr) -> double {
+        if (!task_ptr) {
+            return 0;
+        }
+        switch (task_ptr->algorithm) {
+        case AlgorithmType::MatchTemplate:
+        case AlgorithmType::Hash:
+            return 1;
+        case AlgorithmType::OcrDetect:
+            return std::dynamic_pointer_cast<OcrTaskInfo>(task_ptr)->without_det ? 4 : 10;
+        default:
+            return 0;
+        }
+    };
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const PreTaskStats* stats = nullptr;
+    if (auto iter = m_stats.find(pre_task); iter != m_stats.cend()) {
+        stats = &iter->second;
+    }
+    struct Candidate
+    {
+        std::string name;
+        double cost = 0;
+        double rank = 0;
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve(tasks_name.size());
+    for (const std::string& name : tasks_name) {
+        Candidate candidate { name, cost_of(Task.get(name)) };
+        uint64_t hits = 0;
+        uint64_t total = 0;
+        if (stats) {
+            total = stats->total;
+            if (auto iter = stats->hits.find(name); iter != stats->hits.cend()) {
+                hits = iter->second;
+            }
+        }
+        // 加一平滑，没有统计的时候命中率都是 0.5，只按开销排
+        const double hit_rate = (hits + 1.0) / (total + 2.0);
+        candidate.rank = candidate.cost / hit_rate;
+        candidates.emplace_back(std::move(candidate));
+    }
+    lock.unlock();
+
+    // 按分界切成几段，段内排序
+    for (auto begin = candidates.begin(); begin != candidates.end();) {
+        auto end = std::find_if(begin, candidates.end(), [](const Candidate& c) { return c.cost == 0; });
+        std::stable_sort(begin, end, [](const Candidate& lhs, const Candidate& rhs) { return lhs.rank < rhs.rank; });
+        begin = end == candidates.end() ? end : end + 1;
+    }
+
+    std::vector<std::string> result;
+    result.reserve(candidates.size());
+    for (auto& candidate : candidates) {
+        result.emplace_back(std::move(candidate.name));
+    }
+    return result;
+}
+
+void asst::TaskHitStats::record(const std::string& pre_task, const std::string& hit)
+{
+    if (pre_task.empty()) {
+        return;
+    }
+    // 没标 adaptiveOrder 的不会被调整，记了也用不上，只会让文件越来越大
+    if (auto pre_task_ptr = Task.get(pre_task); !pre_task_ptr || !pre_task_ptr->adaptive_order) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    PreTaskStats& stats = m_stats[pre_task];
+    ++stats.total;
+    if (!hit.empty()) {
+        ++stats.hits[hit];
+    }
+    if (++m_unsaved < SaveInterval) {
+        return;
+    }
+    lock.unlock();
+    save();
+}
+
+void asst::TaskHitStats::save()
+{
+    std::unique_lock<std::mutex> save_lock(m_save_mutex);
+
+    // 锁里只拷一份数据，序列化和写文件都放到锁外面，不耽误识别线程继续记
+    std::filesystem::path path;
+    json::object root;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_path.empty() || m_unsaved == 0) {
+            return;
+        }
+        m_unsaved = 0;
+        path = m_path;
+        for (const auto& [pre_task, stats] : m_stats) {
+            json::object hits;
+            for (const auto& [name, count] : stats.hits) {
+                hits.emplace(name, count);
+            }
+            root.emplace(pre_task, json::object {
+                                       { "total", stats.total },
+                                       { "hits", std::move(hits) },
+                                   });
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    std::ofstream ofs(path, std::ios::out | std::ios::trunc);
+    if (!ofs.is_open()) {
+        Log.warn("failed to save task hit stats", path, ec.message());
+        return;
+    }
+    ofs << json::value(std::move(root)).format();
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "Config/AbstractResource.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace asst
+{
+    // ProcessTask 里每个任务的 next 候选各自命中了多少次。开了 AdaptiveTaskOrder 之后按这个调整识别顺序，
+    // 常出现的、识别开销小的候选先识别，平均每帧要识别的候选更少。统计存在 cache 目录里，下次启动接着用
+    class TaskHitStats final : public SingletonHolder<TaskHitStats>, public AbstractResource
+    {
+    public:
+        virtual ~TaskHitStats() override { save(); }
+
+        virtual bool load(const std::filesystem::path& path) override;
+
+        // 按 开销 / 命中率 从小到大排，一样的保持原顺序。
+        // 只调整上一个任务标了 adaptiveOrder 的；JustReturn 一定命中，其他候选不会跨过它调换
+        std::vector<std::string> reorder(const std::string& pre_task, const std::vector<std::string>& tasks_name) const;
+        // 记一次识别，hit 为命中的任务名，都没命中时为空。只记上一个任务标了 adaptiveOrder 的
+        void record(const std::string& pre_task, const std::string& hit);
+        // 把还没写进文件的统计写进去，实例销毁时调用
+        void save();
+
+    private:
+        struct PreTaskStats
+        {
+            uint64_t total = 0; // 识别了多少次
+            std::unordered_map<std::string, uint64_t> hits;
+        };
+
+        // 记了这么多次之后写一次文件
+        static constexpr size_t SaveInterval = 64;
+
+        mutable std::mutex m_mutex;
+        std::mutex m_save_mutex; // 写文件不拿 m_mutex，单独用这个避免几个线程同时写同一个文件
+        std::unordered_map<std::string, PreTaskStats> m_stats;
+        std::filesystem::path m_path;
+        size_t m_unsaved = 0;
+    };
+}
@@ -12,6 +12,7 @@
 #include "Miscellaneous/OcrPack.h"
 #include "Miscellaneous/RecruitConfig.h"
 #include "Miscellaneous/StageDropsConfig.h"
+#include "Miscellaneous/TaskHitStats.h"
 #include "Miscellaneous/TilePack.h"
 #include "Roguelike/RoguelikeCopilotConfig.h"
 #include "Roguelike/RoguelikeRecruitConfig.h"
@@ -72,6 +73,7 @@ bool asst::ResourceLoader::load(const std::filesystem::path& path)
 
         /* load cache */
         LoadCacheWithoutRet(AvatarCacheManager, "avatars"_p);
+        LoadCacheWithoutRet(TaskHitStats, "task_hit_stats.json"_p);
 
         return true;
     });
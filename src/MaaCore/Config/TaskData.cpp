@@ -342,6 +342,9 @@ asst::TaskData::taskptr_t asst::TaskData::generate_task_info(const std::string&
         Log.error("Unknown algorithm in task", name);
         return nullptr;
     }
+    if (task_info_ptr == nullptr) {
+        return nullptr;
+    }
 
     // 不管什么algorithm，都有基础成员（next, roi, 等等）
     if (!append_base_task_info(task_info_ptr, name, task_json, default_ptr, task_prefix)) {
@@ -374,11 +377,11 @@ asst::TaskData::taskptr_t asst::TaskData::generate_match_task_info(const std::st
     else {
         match_task_info_ptr->mask_range = default_ptr->mask_range;
     }
+    match_task_info_ptr->pyramid_level = task_json.get("pyramidLevel", default_ptr->pyramid_level);
     return match_task_info_ptr;
 }
 
-asst::TaskData::taskptr_t asst::TaskData::generate_ocr_task_info([[maybe_unused]] const std::string& name,
-                                                                 const json::value& task_json,
+asst::TaskData::taskptr_t asst::TaskData::generate_ocr_task_info(const std::string& name, const json::value& task_json,
                                                                  std::shared_ptr<OcrTaskInfo> default_ptr)
 {
     if (default_ptr == nullptr) {
@@ -399,11 +402,32 @@ asst::TaskData::taskptr_t asst::TaskData::generate_ocr_task_info([[maybe_unused]
     ocr_task_info_ptr->without_det = task_json.get("withoutDet", default_ptr->without_det);
     if (auto opt = task_json.find<json::array>("ocrReplace")) {
         for (const json::value& rep : opt.value()) {
-            ocr_task_info_ptr->replace_map.emplace(rep[0].as_string(), rep[1].as_string());
+            OcrReplaceRule rule { .pattern = rep[0].as_string(), .replacement = rep[1].as_string(), .regex = nullptr };
+            // 同一个 pattern 写了多次的只用第一条
+            if (ranges::find(ocr_task_info_ptr->replace_rules, rule.pattern, &OcrReplaceRule::pattern) !=
+                ocr_task_info_ptr->replace_rules.cend()) {
+                continue;
+            }
+            // 纯文本（replacement 里也没有 $ 引用）直接按子串替换，结果和 std::regex_replace 一样
+            constexpr std::string_view RegexSpecialChars = R"(\^$.|?*+()[]{})";
+            bool is_literal = !rule.pattern.empty() &&
+                              rule.pattern.find_first_of(RegexSpecialChars) == std::string::npos &&
+                              rule.replacement.find('$') == std::string::npos;
+            if (!is_literal) {
+                try {
+                    rule.regex = std::make_shared<const std::regex>(rule.pattern, std::regex::ECMAScript |
+                                                                                      std::regex::optimize);
+                }
+                catch (const std::regex_error& e) {
+                    Log.error("Task", name, "has invalid ocrReplace:", rule.pattern, e.what());
+                    return nullptr;
+                }
+            }
+            ocr_task_info_ptr->replace_rules.emplace_back(std::move(rule));
         }
     }
     else {
-        ocr_task_info_ptr->replace_map = default_ptr->replace_map;
+        ocr_task_info_ptr->replace_rules = default_ptr->replace_rules;
     }
     return ocr_task_info_ptr;
 }
@@ -458,6 +482,7 @@ bool asst::TaskData::append_base_task_info(taskptr_t task_info_ptr, const std::s
         task_info_ptr->action = default_ptr->action;
     }
     task_info_ptr->cache = task_json.get("cache", default_ptr->cache);
+    task_info_ptr->adaptive_order = task_json.get("adaptiveOrder", default_ptr->adaptive_order);
     task_info_ptr->max_times = task_json.get("maxTimes", default_ptr->max_times);
     auto array_opt = task_json.find<json::array>("exceededNext");
     task_info_ptr->exceeded_next =
@@ -576,39 +601,39 @@ bool asst::TaskData::syntax_check(const std::string& task_name, const json::valu
     static const std::unordered_map<AlgorithmType, std::unordered_set<std::string>> allowed_key_under_algorithm = {
         { AlgorithmType::Invalid,
           {
-              "action",        "algorithm", "baseTask",        "cache",          "exceededNext",     "fullMatch",
-              "hash",          "isAscii",   "maskRange",       "maxTimes",       "next",             "ocrReplace",
-              "onErrorNext",   "postDelay", "preDelay",        "rectMove",       "reduceOtherTimes", "roi",
-              "specialParams", "sub",       "subErrorIgnored", "templThreshold", "template",         "text",
-              "threshold",     "withoutDet",
+              "action",           "adaptiveOrder", "algorithm",     "baseTask",   "cache",           "exceededNext",
+              "fullMatch",        "hash",          "isAscii",       "maskRange",  "maxTimes",        "next",
+              "ocrReplace",       "onErrorNext",   "postDelay",     "preDelay",   "pyramidLevel",    "rectMove",
+              "reduceOtherTimes", "roi",           "specialParams", "sub",        "subErrorIgnored", "templThreshold",
+              "template",         "text",          "threshold",     "withoutDet",
           } },
         { AlgorithmType::MatchTemplate,
           {
-              "action",           "algorithm", "baseTask",    "cache",           "exceededNext",   "maskRange",
-              "maxTimes",         "next",      "onErrorNext", "postDelay",       "preDelay",       "rectMove",
-              "reduceOtherTimes", "roi",       "sub",         "subErrorIgnored", "templThreshold", "template",
-              "specialParams"
+              "action",         "adaptiveOrder", "algorithm",        "baseTask",    "cache",     "exceededNext",
+              "maskRange",      "maxTimes",      "next",             "onErrorNext", "postDelay", "preDelay",
+              "pyramidLevel",   "rectMove",      "reduceOtherTimes", "roi",         "sub",       "subErrorIgnored",
+              "templThreshold", "template",      "specialParams"
           } },
         { AlgorithmType::OcrDetect,
           {
-              "action",      "algorithm", "baseTask",        "cache",    "exceededNext",
-              "fullMatch",   "isAscii",   "maxTimes",        "next",     "ocrReplace",
-              "onErrorNext", "postDelay", "preDelay",        "rectMove", "reduceOtherTimes",
-              "roi",         "sub",       "subErrorIgnored", "text",     "withoutDet",
-              "specialParams"
+              "action",           "adaptiveOrder", "algorithm", "baseTask",        "cache",
+              "exceededNext",     "fullMatch",     "isAscii",   "maxTimes",        "next",
+              "ocrReplace",       "onErrorNext",   "postDelay", "preDelay",        "rectMove",
+              "reduceOtherTimes", "roi",           "sub",       "subErrorIgnored", "text",
+              "withoutDet",       "specialParams"
           } },
         { AlgorithmType::JustReturn,
           {
-              "action",          "algorithm", "baseTask", "exceededNext",     "maxTimes",      "next",
-              "onErrorNext",     "postDelay", "preDelay", "reduceOtherTimes", "specialParams", "sub",
-              "subErrorIgnored",
+              "action", "adaptiveOrder",   "algorithm", "baseTask", "exceededNext",     "maxTimes",
+              "next",   "onErrorNext",     "postDelay", "preDelay", "reduceOtherTimes", "specialParams",
+              "sub",    "subErrorIgnored",
           } },
         { AlgorithmType::Hash,
           {
-              "action",    "algorithm",        "baseTask", "cache",         "exceededNext", "hash",
-              "maskRange", "maxTimes",         "next",     "onErrorNext",   "postDelay",    "preDelay",
-              "rectMove",  "reduceOtherTimes", "roi",      "specialParams", "sub",          "subErrorIgnored",
-              "threshold",
+              "action",          "adaptiveOrder", "algorithm",        "baseTask", "cache",         "exceededNext",
+              "hash",            "maskRange",     "maxTimes",         "next",     "onErrorNext",   "postDelay",
+              "preDelay",        "rectMove",      "reduceOtherTimes", "roi",      "specialParams", "sub",
+              "subErrorIgnored", "threshold",
           } },
     };
     // clang-format on
@@ -69,4 +69,57 @@ const cv::Mat asst::TemplResource::get_templ(const std::string& key) const noexc
 void asst::TemplResource::insert_or_assign_templ(const std::string& key, cv::Mat&& templ)
 {
     m_templs.insert_or_assign(key, std::move(templ));
+
+    // 模板换了，之前算的都作废
+    std::unique_lock<std::mutex> lock(m_derived_mutex);
+    m_templs_gray.erase(key);
+    std::erase_if(m_templs_mask, [&](const auto& pair) { return std::get<0>(pair.first) == key; });
+}
+
+cv::Mat asst::TemplResource::get_templ_gray(const std::string& key)
+{
+    std::unique_lock<std::mutex> lock(m_derived_mutex);
+    return get_templ_gray_unlocked(key);
+}
+
+cv::Mat asst::TemplResource::get_templ_mask(const std::string& key, std::pair<int, int> mask_range, bool with_close)
+{
+    std::unique_lock<std::mutex> lock(m_derived_mutex);
+    MaskKey mask_key { key, mask_range.first, mask_range.second, with_close };
+    if (auto iter = m_templs_mask.find(mask_key); iter != m_templs_mask.cend()) {
+        return iter->second;
+    }
+    cv::Mat gray = get_templ_gray_unlocked(key);
+    if (gray.empty()) {
+        return cv::Mat();
+    }
+    cv::Mat mask = make_mask(gray, mask_range, with_close);
+    m_templs_mask.emplace(std::move(mask_key), mask);
+    return mask;
+}
+
+cv::Mat asst::TemplResource::make_mask(const cv::Mat& gray, std::pair<int, int> mask_range, bool with_close)
+{
+    cv::Mat mask;
+    cv::inRange(gray, mask_range.first, mask_range.second, mask);
+    if (with_close) {
+        cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+        cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel);
+    }
+    return mask;
+}
+
+cv::Mat asst::TemplResource::get_templ_gray_unlocked(const std::string& key)
+{
+    if (auto iter = m_templs_gray.find(key); iter != m_templs_gray.cend()) {
+        return iter->second;
+    }
+    auto templ_iter = m_templs.find(key);
+    if (templ_iter == m_templs.cend() || templ_iter->second.empty()) {
+        return cv::Mat();
+    }
+    cv::Mat gray;
+    cv::cvtColor(templ_iter->second, gray, cv::COLOR_BGR2GRAY);
+    m_templs_gray.emplace(key, gray);
+    return gray;
 }
@@ -2,6 +2,9 @@
 
 #include "AbstractResource.h"
 
+#include <map>
+#include <mutex>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -23,10 +26,25 @@ namespace asst
 
         void insert_or_assign_templ(const std::string& key, cv::Mat&& templ);
 
+        // 模板的灰度图和按 mask_range 算出来的掩码，第一次用到时算好缓存起来，之后直接拿。模板不存在时返回空
+        cv::Mat get_templ_gray(const std::string& key);
+        cv::Mat get_templ_mask(const std::string& key, std::pair<int, int> mask_range, bool with_close);
+
+        // 不在资源里的模板（比如运行时截下来的）也按同样的规则算掩码
+        static cv::Mat make_mask(const cv::Mat& gray, std::pair<int, int> mask_range, bool with_close);
+
     private:
+        cv::Mat get_templ_gray_unlocked(const std::string& key);
+
         std::unordered_set<std::string> m_templs_filename;
         std::unordered_map<std::string, cv::Mat> m_templs;
 
+        // 模板名, 掩码下限, 掩码上限, 是否闭运算
+        using MaskKey = std::tuple<std::string, int, int, bool>;
+        std::mutex m_derived_mutex; // 多个实例的识别线程会同时来取
+        std::unordered_map<std::string, cv::Mat> m_templs_gray;
+        std::map<MaskKey, cv::Mat> m_templs_mask;
+
         bool m_loaded = false;
     };
 }
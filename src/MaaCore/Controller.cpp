@@ -7,6 +7,7 @@
 #else
 #include <fcntl.h>
 #include <signal.h>
+#include <poll.h>
 #include <sys/errno.h>
 #ifndef __APPLE__
 #include <sys/prctl.h>
@@ -16,8 +17,10 @@
 #endif
 
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstdint>
+#include <limits>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -52,6 +55,10 @@ asst::Controller::Controller(const AsstCallback& callback, Assistant* inst)
     int pipe_in_ret = ::pipe(m_pipe_in);
     int pipe_out_ret = ::pipe(m_pipe_out);
     ::fcntl(m_pipe_out[PIPE_READ], F_SETFL, O_NONBLOCK);
+    // 子进程只通过 dup2 拿到需要的那两个，其它的 fork 出去的进程不要继承
+    for (int fd : { m_pipe_in[PIPE_READ], m_pipe_in[PIPE_WRITE], m_pipe_out[PIPE_READ], m_pipe_out[PIPE_WRITE] }) {
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
 
     if (pipe_in_ret < 0 || pipe_out_ret < 0) {
         Log.error(__FUNCTION__, "controller pipe created failed", pipe_in_ret, pipe_out_ret);
@@ -68,7 +75,12 @@ asst::Controller::~Controller()
 {
     LogTraceFunction;
 
+    stop_input_thread();
+    stop_prefetch();
+    Log.info("resized image cache hits:", m_resize_cache_hits.load(), ", misses:", m_resize_cache_misses.load());
     release_minitouch();
+    release_shell_session();
+    release_frame_stream();
     make_instance_inited(false);
     kill_adb_daemon();
 
@@ -80,13 +92,51 @@ asst::Controller::~Controller()
 #endif
 }
 
+std::pair<size_t, size_t> asst::Controller::get_resize_cache_stats() const noexcept
+{
+    return { m_resize_cache_hits.load(), m_resize_cache_misses.load() };
+}
+
+json::value asst::Controller::get_latency_stats() const
+{
+    static const std::array<std::string, static_cast<size_t>(LatencyStage::Count)> StageNames = {
+        "Spawn", "Transfer", "ConvertLf", "Decode", "Resize", "Click", "Swipe",
+    };
+
+    json::value stats;
+    for (size_t i = 0; i < StageNames.size(); ++i) {
+        stats[StageNames[i]] = m_latency[i].summary();
+    }
+    return stats;
+}
+
+void asst::Controller::report_latency_if_needed()
+{
+    static constexpr auto LatencyReportInterval = std::chrono::minutes(1);
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_last_latency_report < LatencyReportInterval) {
+        return;
+    }
+    m_last_latency_report = now;
+
+    json::value info = json::object {
+        { "uuid", m_uuid },
+        { "what", "LatencyStats" },
+        { "why", "" },
+        { "details", get_latency_stats() },
+    };
+    callback(AsstMsg::ConnectionInfo, info);
+}
+
 std::pair<int, int> asst::Controller::get_scale_size() const noexcept
 {
     return m_scale_size;
 }
 
 std::optional<std::string> asst::Controller::call_command(const std::string& cmd, int64_t timeout, bool allow_reconnect,
-                                                          bool recv_by_socket)
+                                                          bool recv_by_socket, std::string recv_buffer,
+                                                          const PipeDataFunc& pipe_data_func)
 {
     using namespace std::chrono_literals;
     using namespace std::chrono;
@@ -94,10 +144,47 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
 
     std::string pipe_data;
     std::string sock_data;
+    // clear 不会释放容量，复用的缓冲区接下来的 insert 基本不需要再扩容
+    (recv_by_socket ? sock_data : pipe_data) = std::move(recv_buffer);
+    pipe_data.clear();
+    sock_data.clear();
     asst::platform::single_page_buffer<char> pipe_buffer;
     asst::platform::single_page_buffer<char> sock_buffer;
 
     auto start_time = steady_clock::now();
+
+    auto shell_cmd = recv_by_socket ? std::nullopt : shell_command_of(cmd);
+    if (shell_cmd && m_shell_session_available) {
+        int session_ret = 0;
+        auto session_output = call_by_shell_session(shell_cmd.value(), timeout, session_ret);
+        latency(LatencyStage::Transfer).record(steady_clock::now() - start_time);
+        auto duration = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+        if (session_output) {
+            // 读到了结束标记，说明命令在设备上执行完了。退出码不为 0 也不能再拉起进程重跑一遍，
+            // 点击、启动应用之类的命令会被执行两次，和原来一样按失败处理
+            Log.info("Call `", cmd, "` by shell session ret", session_ret, ", cost", duration,
+                     "ms , stdout size:", session_output->size());
+            if (!session_output->empty() && session_output->size() < 4096) {
+                Log.trace("stdout output:", Logger::separator::newline, session_output.value());
+            }
+            return on_command_finished(cmd, timeout, allow_reconnect, recv_by_socket, session_ret,
+                                       std::move(session_output).value());
+        }
+        // 会话挂了，回退到每次拉起进程的方式，等重连的时候再重新建立会话
+        Log.warn("shell session is broken, fallback to spawn");
+        release_shell_session();
+    }
+    else if (shell_cmd && m_adb_client) {
+        // 和 shell 会话一样，拿到退出码就说明命令执行过了，只有 adb server 出问题了才再走原来的路径
+        int shell_ret = 0;
+        auto ret = m_adb_client->shell(shell_cmd.value(), shell_ret, timeout);
+        latency(LatencyStage::Transfer).record(steady_clock::now() - start_time);
+        if (ret) {
+            return on_command_finished(cmd, timeout, allow_reconnect, recv_by_socket, shell_ret,
+                                       std::move(ret).value());
+        }
+    }
+
     std::unique_lock<std::mutex> callcmd_lock(m_callcmd_mutex);
 
 #ifdef _WIN32
@@ -123,12 +210,15 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
     ASST_AUTO_DEDUCED_ZERO_INIT_END
 
     auto cmdline_osstr = asst::utils::to_osstring(cmd);
+    auto spawn_start_time = steady_clock::now();
     BOOL create_ret =
         CreateProcessW(nullptr, cmdline_osstr.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr, &si, &process_info);
     if (!create_ret) {
         Log.error("Call `", cmd, "` create process failed, ret", create_ret);
         return std::nullopt;
     }
+    auto transfer_start_time = steady_clock::now();
+    latency(LatencyStage::Spawn).record(transfer_start_time - spawn_start_time);
 
     CloseHandle(pipe_child_write);
     pipe_child_write = INVALID_HANDLE_VALUE;
@@ -227,6 +317,7 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
             DWORD len = 0;
             if (GetOverlappedResult(pipe_parent_read, &pipeov, &len, FALSE)) {
                 pipe_data.insert(pipe_data.end(), pipe_buffer.get(), pipe_buffer.get() + len);
+                if (pipe_data_func) pipe_data_func(pipe_buffer.get(), len);
                 (void)ReadFile(pipe_parent_read, pipe_buffer.get(), (DWORD)pipe_buffer.size(), nullptr, &pipeov);
             }
             else {
@@ -298,64 +389,108 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
         return timeout && timeout < duration_cast<milliseconds>(steady_clock::now() - start_time).count();
     };
 
-    int exit_ret = 0;
-    m_child = ::fork();
-    if (m_child == 0) {
-        // child process
-
-        ::dup2(m_pipe_in[PIPE_READ], STDIN_FILENO);
-        ::dup2(m_pipe_out[PIPE_WRITE], STDOUT_FILENO);
-        ::dup2(m_pipe_out[PIPE_WRITE], STDERR_FILENO);
-
-        // all these are for use by parent only
-        // close(m_pipe_in[PIPE_READ]);
-        // close(m_pipe_in[PIPE_WRITE]);
-        // close(m_pipe_out[PIPE_READ]);
-        // close(m_pipe_out[PIPE_WRITE]);
-
-        exit_ret = execlp("sh", "sh", "-c", cmd.c_str(), nullptr);
-        ::exit(exit_ret);
-    }
-    else if (m_child > 0) {
-        // parent process
-        do {
-            if (recv_by_socket) {
-                sockaddr addr {};
-                socklen_t len = sizeof(addr);
-                sock_buffer = asst::platform::single_page_buffer<char>();
-
-                int client_socket = ::accept(m_server_sock, &addr, &len);
-                if (client_socket < 0) {
-                    Log.error("accept failed:", strerror(errno));
-                    return std::nullopt;
-                }
+    auto remaining_timeout = [&]() -> int {
+        // 没设超时的时候也别一直睡死，隔一会儿看一下 need_exit
+        constexpr int64_t MaxWaitInterval = 500;
+        if (!timeout) return static_cast<int>(MaxWaitInterval);
+        auto remaining = timeout - duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+        return static_cast<int>(std::clamp<int64_t>(remaining, 0, MaxWaitInterval));
+    };
 
-                ssize_t read_num = ::read(client_socket, sock_buffer.get(), sock_buffer.size());
+    int exit_ret = 0;
+    auto spawn_start_time = steady_clock::now();
+    m_child = posix::spawn_shell(cmd, m_pipe_in[PIPE_READ], m_pipe_out[PIPE_WRITE]);
+    if (m_child < 0) {
+        // failed to create child process
+        Log.error("Call `", cmd, "` create process failed, child:", m_child);
+        return std::nullopt;
+    }
+    auto transfer_start_time = steady_clock::now();
+    latency(LatencyStage::Spawn).record(transfer_start_time - spawn_start_time);
 
-                while (read_num > 0) {
-                    sock_data.insert(sock_data.end(), sock_buffer.get(), sock_buffer.get() + read_num);
-                    read_num = ::read(client_socket, sock_buffer.get(), sock_buffer.size());
-                }
+    posix::ChildExitWatcher watcher(m_child);
+    bool child_exited = false;
+    auto wait_child = [&](int read_fd) {
+        if (::waitpid(m_child, &exit_ret, WNOHANG) != 0) {
+            child_exited = true;
+            return;
+        }
+        posix::wait_readable_or_exit(read_fd, watcher, remaining_timeout());
+    };
 
-                ::close(client_socket);
+    if (recv_by_socket) {
+        // 子进程起不来或者没连上就退出了的话，accept 会一直卡着，所以先和子进程一起等 socket 可读
+        while (!child_exited && !check_timeout() && !need_exit()) {
+            pollfd accept_fd { m_server_sock, POLLIN, 0 };
+            if (::poll(&accept_fd, 1, 0) > 0) {
                 break;
             }
+            wait_child(m_server_sock);
+        }
+
+        pollfd accept_fd { m_server_sock, POLLIN, 0 };
+        if (::poll(&accept_fd, 1, 0) <= 0) {
+            Log.error("accept failed: no connection, child exited:", child_exited);
+            if (!child_exited) {
+                ::kill(m_child, SIGKILL);
+                ::waitpid(m_child, &exit_ret, 0);
+            }
+            return std::nullopt;
+        }
 
-            ssize_t read_num = ::read(m_pipe_out[PIPE_READ], pipe_buffer.get(), pipe_buffer.size());
+        sockaddr addr {};
+        socklen_t len = sizeof(addr);
+        sock_buffer = asst::platform::single_page_buffer<char>();
 
-            while (read_num > 0) {
-                pipe_data.insert(pipe_data.end(), pipe_buffer.get(), pipe_buffer.get() + read_num);
-                read_num = ::read(m_pipe_out[PIPE_READ], pipe_buffer.get(), pipe_buffer.size());
+        int client_socket = ::accept(m_server_sock, &addr, &len);
+        if (client_socket < 0) {
+            Log.error("accept failed:", strerror(errno));
+            if (!child_exited) {
+                ::kill(m_child, SIGKILL);
+                ::waitpid(m_child, &exit_ret, 0);
             }
-        } while (::waitpid(m_child, &exit_ret, WNOHANG) == 0 && !check_timeout());
+            return std::nullopt;
+        }
+
+        ssize_t read_num = ::read(client_socket, sock_buffer.get(), sock_buffer.size());
+
+        while (read_num > 0) {
+            sock_data.insert(sock_data.end(), sock_buffer.get(), sock_buffer.get() + read_num);
+            read_num = ::read(client_socket, sock_buffer.get(), sock_buffer.size());
+        }
+
+        ::close(client_socket);
+        // 之前读完 socket 就直接返回了，子进程没人收尸会变成僵尸进程，这里接着走下面的等待
     }
-    else {
-        // failed to create child process
-        Log.error("Call `", cmd, "` create process failed, child:", m_child);
+
+    auto read_pipe = [&]() {
+        ssize_t read_num = ::read(m_pipe_out[PIPE_READ], pipe_buffer.get(), pipe_buffer.size());
+
+        while (read_num > 0) {
+            pipe_data.insert(pipe_data.end(), pipe_buffer.get(), pipe_buffer.get() + read_num);
+            if (pipe_data_func) pipe_data_func(pipe_buffer.get(), static_cast<size_t>(read_num));
+            read_num = ::read(m_pipe_out[PIPE_READ], pipe_buffer.get(), pipe_buffer.size());
+        }
+    };
+
+    while (!child_exited && !check_timeout()) {
+        read_pipe();
+        wait_child(m_pipe_out[PIPE_READ]);
+    }
+    // 子进程退出前写的数据可能还留在管道里
+    read_pipe();
+    if (!child_exited) {
+        // 超时了，和上面 socket 的情况一样杀掉并收尸，不能当成执行成功
+        Log.error("Call `", cmd, "` timeout, kill the child process");
+        ::kill(m_child, SIGKILL);
+        ::waitpid(m_child, &exit_ret, 0);
+        // 管道是复用的，剩下的输出要读掉，不然会混进下一条命令的输出里
+        read_pipe();
         return std::nullopt;
     }
 #endif
 
+    latency(LatencyStage::Transfer).record(steady_clock::now() - transfer_start_time);
     callcmd_lock.unlock();
 
     auto duration = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
@@ -367,6 +502,16 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
     if (recv_by_socket && !sock_data.empty() && sock_data.size() < 4096) {
         Log.trace("socket output:", Logger::separator::newline, sock_data);
     }
+    return on_command_finished(cmd, timeout, allow_reconnect, recv_by_socket, static_cast<int>(exit_ret),
+                               std::move(recv_by_socket ? sock_data : pipe_data));
+}
+
+std::optional<std::string> asst::Controller::on_command_finished(const std::string& cmd, int64_t timeout,
+                                                                 bool allow_reconnect, bool recv_by_socket,
+                                                                 int exit_ret, std::string output)
+{
+    using namespace std::chrono;
+
     // 直接 return，避免走到下面的 else if 里的 make_instance_inited(false) 关闭 adb 连接，
     // 导致停止后再开始任务还需要重连一次
     if (need_exit()) {
@@ -374,7 +519,7 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
     }
 
     if (!exit_ret) {
-        return recv_by_socket ? sock_data : pipe_data;
+        return output;
     }
     else if (inited() && allow_reconnect) {
         // 之前可以运行，突然运行不了了，这种情况多半是 adb 炸了。所以重新连接一下
@@ -388,6 +533,10 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
                   { "cmd", cmd },
               } },
         };
+        auto& registry = DeviceRegistry::get_instance();
+        // 只有在这次失败之后别的实例重连成功了，才能直接用它的结果；
+        // 不能只看最近有没有连上过，不然刚连上就断线的话会一直跳过 adb connect
+        uint64_t failed_generation = registry.connect_generation(m_device_key);
         static constexpr int ReconnectTimes = 20;
         for (int i = 0; i < ReconnectTimes; ++i) {
             if (need_exit()) {
@@ -396,18 +545,31 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
             reconnect_info["details"]["times"] = i;
             callback(AsstMsg::ConnectionInfo, reconnect_info);
 
-            sleep(10 * 1000);
-            if (need_exit()) {
-                break;
-            }
-            auto reconnect_ret = call_command(m_adb.connect, 60LL * 1000, false /* 禁止重连避免无限递归 */);
+            // 退避时间是同一台设备的所有实例共用的，连续失败时越等越久
+            sleep(static_cast<unsigned>(duration_cast<milliseconds>(registry.reconnect_delay(m_device_key)).count()));
             if (need_exit()) {
                 break;
             }
+            // 同一台设备的几个实例一起断线时只让一个去 adb connect，其他的等它的结果
             bool is_reconnect_success = false;
-            if (reconnect_ret) {
-                auto& reconnect_str = reconnect_ret.value();
-                is_reconnect_success = reconnect_str.find("error") == std::string::npos;
+            {
+                auto device_lock = registry.lock_device(m_device_key);
+                if (registry.connect_generation(m_device_key) != failed_generation) {
+                    Log.info("device is reconnected by another instance");
+                    is_reconnect_success = true;
+                }
+                else {
+                    auto reconnect_ret =
+                        call_command(m_adb.connect, 60LL * 1000, false /* 禁止重连避免无限递归 */);
+                    if (need_exit()) {
+                        break;
+                    }
+                    if (reconnect_ret) {
+                        auto& reconnect_str = reconnect_ret.value();
+                        is_reconnect_success = reconnect_str.find("error") == std::string::npos;
+                    }
+                    registry.on_reconnect_result(m_device_key, is_reconnect_success);
+                }
             }
             if (is_reconnect_success) {
                 if (m_minitouch_enabled && call_and_hup_minitouch()) {
@@ -418,6 +580,10 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
                     Log.error("reconnected without minitouch");
                     m_minitouch_available = false;
                 }
+                call_and_hup_shell_session();
+                if (!m_adb.call_stream_emitter.empty()) {
+                    call_and_hup_frame_stream();
+                }
                 auto recall_ret = call_command(cmd, timeout, false /* 禁止重连避免无限递归 */, recv_by_socket);
                 if (recall_ret) {
                     // 重连并成功执行了
@@ -425,6 +591,8 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
                     callback(AsstMsg::ConnectionInfo, reconnect_info);
                     return recall_ret;
                 }
+                // 重连上了还是执行不了，算是又一次失败，下次得自己再 adb connect
+                failed_generation = registry.connect_generation(m_device_key);
             }
         }
         json::value info = json::object {
@@ -436,6 +604,7 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
                   { "cmd", m_adb.connect },
               } },
         };
+        DeviceRegistry::get_instance().invalidate(m_device_key);
         make_instance_inited(false); // 重连失败，释放
         callback(AsstMsg::ConnectionInfo, info);
     }
@@ -665,9 +834,20 @@ bool asst::Controller::input_to_minitouch(const std::string& cmd)
     return cmd.size() == written;
 #else
     if (m_minitouch_process < 0 || m_write_to_minitouch_fd < 0) return false;
-    if (::write(m_write_to_minitouch_fd, cmd.c_str(), cmd.length()) >= 0) return true;
-    Log.error("Failed to write to minitouch, err", errno);
-    return false;
+    // 一个手势的命令是攒在一起写的，可能比较长，写不完的话接着写
+    const char* data = cmd.c_str();
+    size_t remaining = cmd.length();
+    while (remaining > 0) {
+        ssize_t written = ::write(m_write_to_minitouch_fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            Log.error("Failed to write to minitouch, err", errno);
+            return false;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    return true;
 #endif
 }
 
@@ -707,6 +887,342 @@ void asst::Controller::release_minitouch(bool force)
 #endif //  _WIN32
 }
 
+bool asst::Controller::call_and_hup_shell_session()
+{
+    LogTraceFunction;
+    release_shell_session();
+
+    if (m_adb.shell_session.empty()) {
+        return false;
+    }
+    const std::string& cmd = m_adb.shell_session;
+    Log.info(cmd);
+
+    std::unique_lock<std::mutex> session_lock(m_shell_session_mutex);
+
+#ifdef _WIN32
+    constexpr int PipeBuffSize = 64 * 1024;
+
+    SECURITY_ATTRIBUTES sa_attr_inherit {
+        .nLength = sizeof(SECURITY_ATTRIBUTES),
+        .lpSecurityDescriptor = nullptr,
+        .bInheritHandle = TRUE,
+    };
+    HANDLE pipe_parent_read = INVALID_HANDLE_VALUE, pipe_child_write = INVALID_HANDLE_VALUE;
+    HANDLE pipe_child_read = INVALID_HANDLE_VALUE, pipe_parent_write = INVALID_HANDLE_VALUE;
+    if (!asst::win32::CreateOverlappablePipe(&pipe_parent_read, &pipe_child_write, nullptr, &sa_attr_inherit,
+                                             PipeBuffSize, true, false) ||
+        !asst::win32::CreateOverlappablePipe(&pipe_child_read, &pipe_parent_write, &sa_attr_inherit, nullptr,
+                                             PipeBuffSize, false, false)) {
+        DWORD err = GetLastError();
+        Log.error("Failed to create pipe for shell session, err", err);
+        return false;
+    }
+
+    STARTUPINFOW si {};
+    si.cb = sizeof(STARTUPINFOW);
+    si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
+    si.wShowWindow = SW_HIDE;
+    si.hStdInput = pipe_child_read;
+    si.hStdOutput = pipe_child_write;
+    si.hStdError = pipe_child_write;
+
+    auto cmd_osstr = utils::to_osstring(cmd);
+    BOOL create_ret = CreateProcessW(NULL, cmd_osstr.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr, &si,
+                                     &m_shell_session_process_info);
+    CloseHandle(pipe_child_write);
+    CloseHandle(pipe_child_read);
+
+    m_shell_session_parent_read = pipe_parent_read;
+    m_shell_session_parent_write = pipe_parent_write;
+    m_shell_session_read_event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+    if (!create_ret) {
+        DWORD err = GetLastError();
+        Log.error("Failed to create process for shell session, err", err);
+        session_lock.unlock();
+        release_shell_session();
+        return false;
+    }
+#else
+    int pipe_to_child[2];
+    int pipe_from_child[2];
+
+    if (::pipe(pipe_to_child)) return false;
+    if (::pipe(pipe_from_child)) {
+        ::close(pipe_to_child[0]);
+        ::close(pipe_to_child[1]);
+        return false;
+    }
+    // 会话一直开着，四个端都不能漏给之后拉起的 adb 进程（尤其是会常驻的 adb server），
+    // 子进程用的两端在 spawn 时 dup2 到 stdin / stdout 上，dup2 出来的不带 CLOEXEC
+    for (int fd : { pipe_to_child[0], pipe_to_child[1], pipe_from_child[0], pipe_from_child[1] }) {
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    ::pid_t pid = posix::spawn_shell(cmd, pipe_to_child[0], pipe_from_child[1]);
+    ::close(pipe_to_child[0]);
+    ::close(pipe_from_child[1]);
+    if (pid < 0) {
+        Log.error("failed to create process");
+        ::close(pipe_to_child[1]);
+        ::close(pipe_from_child[0]);
+        return false;
+    }
+
+    m_shell_session_process = pid;
+    m_write_to_shell_session_fd = pipe_to_child[1];
+    m_read_from_shell_session_fd = pipe_from_child[0];
+#endif
+
+    m_shell_session_available = true;
+    session_lock.unlock();
+
+    // 握手：拆开的引号保证 tty 回显的命令行里不会出现完整的标记
+    int exit_ret = -1;
+    static const std::string ReadyMarker = "###MAA_SHELL_READY###";
+    auto ready_ret = call_by_shell_session(R"(echo "###MAA_SHELL_""READY###")", 3000, exit_ret);
+    if (!ready_ret || exit_ret != 0 || ready_ret->find(ReadyMarker) == std::string::npos) {
+        Log.info("shell session handshake failed");
+        release_shell_session();
+        return false;
+    }
+    if (ready_ret->find("MAA_SHELL_\"\"READY") != std::string::npos) {
+        // 老版本 adb 会给 shell 分配 tty，输入会被回显到输出里，没法可靠地分帧
+        Log.info("shell session is echoing input, disabled");
+        release_shell_session();
+        return false;
+    }
+    Log.info("shell session is ready");
+    return true;
+}
+
+std::optional<std::string> asst::Controller::shell_command_of(const std::string& cmd) const
+{
+    if (m_adb.shell_session.empty()) {
+        return std::nullopt;
+    }
+    const std::string prefix = m_adb.shell_session + " ";
+    if (!cmd.starts_with(prefix)) {
+        return std::nullopt;
+    }
+    std::string_view rest = std::string_view(cmd).substr(prefix.size());
+
+    // `shell "..."` 整体引号包起来的，去掉引号后原样交给设备上的 sh
+    if (rest.size() >= 2 && rest.front() == '"' && rest.back() == '"' && rest.find('"', 1) == rest.size() - 1) {
+        return std::string(rest.substr(1, rest.size() - 2));
+    }
+    // 其他带有 host 端 shell 语义的（管道、重定向、引号等）都走原来的路径，保证行为一致
+    if (rest.empty() || rest.find_first_of("|&;<>`$\"'\\") != std::string_view::npos) {
+        return std::nullopt;
+    }
+    return std::string(rest);
+}
+
+std::optional<std::string> asst::Controller::call_by_shell_session(const std::string& cmd, int64_t timeout,
+                                                                   int& exit_ret)
+{
+    std::unique_lock<std::mutex> session_lock(m_shell_session_mutex);
+    if (!m_shell_session_available) {
+        return std::nullopt;
+    }
+
+    // 用拆开的引号拼出结束标记，同样是为了避免和回显的命令行混淆
+    std::string seq = std::to_string(++m_shell_session_seq);
+    std::string marker = "###MAA_SHELL_END_" + seq + "###:";
+    std::string input = "{ " + cmd + "; } </dev/null 2>&1; echo \"###MAA_SHELL_END_\"\"" + seq + "###:$?\"\n";
+
+#ifdef _WIN32
+    DWORD written = 0;
+    if (!WriteFile(m_shell_session_parent_write, input.c_str(), static_cast<DWORD>(input.size()), &written, NULL) ||
+        written != input.size()) {
+        Log.error("Failed to write to shell session, err", GetLastError());
+        return std::nullopt;
+    }
+#else
+    // 进程已经退出的话再写管道会收到 SIGPIPE
+    if (::waitpid(m_shell_session_process, nullptr, WNOHANG) != 0) {
+        Log.error("shell session process exited");
+        m_shell_session_process = -1;
+        return std::nullopt;
+    }
+    for (size_t offset = 0; offset < input.size();) {
+        ssize_t ret = ::write(m_write_to_shell_session_fd, input.c_str() + offset, input.size() - offset);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            Log.error("Failed to write to shell session, err", errno);
+            return std::nullopt;
+        }
+        offset += static_cast<size_t>(ret);
+    }
+#endif
+
+    auto output = read_shell_session_until(marker, timeout);
+    if (!output) {
+        return std::nullopt;
+    }
+
+    // 标记后面紧跟着退出码和换行
+    size_t code_pos = output->rfind(marker);
+    exit_ret = std::atoi(output->c_str() + code_pos + marker.size());
+    output->erase(code_pos);
+    return output;
+}
+
+std::optional<std::string> asst::Controller::read_shell_session_until(const std::string& marker, int64_t timeout)
+{
+    using namespace std::chrono;
+    const auto start_time = steady_clock::now();
+    auto remaining_ms = [&]() -> int64_t {
+        return timeout - duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+    };
+
+    std::string& data = m_shell_session_pending;
+    asst::platform::single_page_buffer<char> buffer;
+
+    while (true) {
+        if (size_t pos = data.find(marker); pos != std::string::npos) {
+            if (size_t eol = data.find('\n', pos + marker.size()); eol != std::string::npos) {
+                std::string result = data.substr(0, eol + 1);
+                data.erase(0, eol + 1);
+                return result;
+            }
+        }
+        if (need_exit() || remaining_ms() <= 0) {
+            Log.warn("shell session read timeout");
+            return std::nullopt;
+        }
+
+#ifdef _WIN32
+        OVERLAPPED ov { .hEvent = m_shell_session_read_event };
+        ResetEvent(ov.hEvent);
+        DWORD len = 0;
+        if (!ReadFile(m_shell_session_parent_read, buffer.get(), (DWORD)buffer.size(), nullptr, &ov)) {
+            DWORD err = GetLastError();
+            if (err != ERROR_IO_PENDING) {
+                Log.error("Failed to read from shell session, err", err);
+                return std::nullopt;
+            }
+            if (WaitForSingleObject(ov.hEvent, (DWORD)(std::max)(remaining_ms(), 0LL)) != WAIT_OBJECT_0) {
+                CancelIoEx(m_shell_session_parent_read, &ov);
+                GetOverlappedResult(m_shell_session_parent_read, &ov, &len, TRUE);
+                continue;
+            }
+        }
+        if (!GetOverlappedResult(m_shell_session_parent_read, &ov, &len, FALSE) || len == 0) {
+            Log.error("shell session pipe closed, err", GetLastError());
+            return std::nullopt;
+        }
+        data.append(buffer.get(), len);
+#else
+        pollfd pfd { .fd = m_read_from_shell_session_fd, .events = POLLIN, .revents = 0 };
+        int poll_ret = ::poll(&pfd, 1, static_cast<int>(std::max<int64_t>(remaining_ms(), 0)));
+        if (poll_ret < 0) {
+            if (errno == EINTR) continue;
+            Log.error("poll shell session failed, err", errno);
+            return std::nullopt;
+        }
+        if (poll_ret == 0) {
+            continue;
+        }
+        ssize_t read_num = ::read(m_read_from_shell_session_fd, buffer.get(), buffer.size());
+        if (read_num <= 0) {
+            if (read_num < 0 && errno == EINTR) continue;
+            Log.error("shell session pipe closed, err", errno);
+            return std::nullopt;
+        }
+        data.append(buffer.get(), static_cast<size_t>(read_num));
+#endif
+    }
+}
+
+void asst::Controller::release_shell_session()
+{
+    std::unique_lock<std::mutex> session_lock(m_shell_session_mutex);
+
+    m_shell_session_available = false;
+    m_shell_session_pending.clear();
+
+#ifdef _WIN32
+    if (m_shell_session_parent_write != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_shell_session_parent_write);
+        m_shell_session_parent_write = INVALID_HANDLE_VALUE;
+    }
+    if (m_shell_session_parent_read != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_shell_session_parent_read);
+        m_shell_session_parent_read = INVALID_HANDLE_VALUE;
+    }
+    if (m_shell_session_read_event != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_shell_session_read_event);
+        m_shell_session_read_event = INVALID_HANDLE_VALUE;
+    }
+    if (m_shell_session_process_info.hProcess != INVALID_HANDLE_VALUE) {
+        TerminateProcess(m_shell_session_process_info.hProcess, 0);
+        CloseHandle(m_shell_session_process_info.hProcess);
+        m_shell_session_process_info.hProcess = INVALID_HANDLE_VALUE;
+    }
+    if (m_shell_session_process_info.hThread != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_shell_session_process_info.hThread);
+        m_shell_session_process_info.hThread = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_write_to_shell_session_fd != -1) {
+        ::close(m_write_to_shell_session_fd);
+        m_write_to_shell_session_fd = -1;
+    }
+    if (m_read_from_shell_session_fd != -1) {
+        ::close(m_read_from_shell_session_fd);
+        m_read_from_shell_session_fd = -1;
+    }
+    if (m_shell_session_process > 0) {
+        ::kill(m_shell_session_process, SIGTERM);
+        ::waitpid(m_shell_session_process, nullptr, 0);
+        m_shell_session_process = -1;
+    }
+#endif
+}
+
+bool asst::Controller::call_and_hup_frame_stream()
+{
+    LogTraceFunction;
+    release_frame_stream();
+
+    if (m_adb.call_stream_emitter.empty() || m_adb.forward_stream.empty()) {
+        return false;
+    }
+
+    // `adb forward tcp:0 ...` 会输出分到的端口号
+    auto forward_ret = call_command(m_adb.forward_stream, 20000, false);
+    if (!forward_ret) {
+        return false;
+    }
+    int port = std::atoi(forward_ret->c_str());
+    if (port <= 0 || port > 65535) {
+        Log.error("invalid stream forward port", *forward_ret);
+        return false;
+    }
+    m_stream_port = static_cast<unsigned short>(port);
+
+    auto stream = std::make_unique<FrameStreamReceiver>(m_width, m_height);
+    if (!stream->start(m_adb.call_stream_emitter, m_stream_port)) {
+        release_frame_stream();
+        return false;
+    }
+    m_frame_stream = std::move(stream);
+    return true;
+}
+
+void asst::Controller::release_frame_stream()
+{
+    m_frame_stream = nullptr;
+    if (m_stream_port && !m_adb.remove_forward_stream.empty()) {
+        call_command(utils::string_replace_all(m_adb.remove_forward_stream,
+                                               { { "[StreamPort]", std::to_string(m_stream_port) } }),
+                     20000, false);
+    }
+    m_stream_port = 0;
+}
+
 // 返回值代表是否找到 "\r\n"，函数本身会将所有 "\r\n" 替换为 "\n"
 bool asst::Controller::convert_lf(std::string& data)
 {
@@ -765,6 +1281,18 @@ asst::Point asst::Controller::rand_point_in_rect(const Rect& rect)
     return { x, y };
 }
 
+bool asst::Controller::replay_or_record_input(json::value input)
+{
+    if (m_session_replayer) {
+        m_session_replayer->add_input(std::move(input));
+        return true;
+    }
+    if (m_session_recorder) {
+        m_session_recorder->add_input(std::move(input));
+    }
+    return false;
+}
+
 void asst::Controller::random_delay() const
 {
     auto& opt = Config.get_options();
@@ -789,6 +1317,17 @@ void asst::Controller::clear_info() noexcept
     m_scale_size = { WindowWidthDefault, WindowHeightDefault };
     m_minitouch_props = decltype(m_minitouch_props)();
     m_screencap_data_general_size = 0;
+    m_screencap_stats.clear();
+    m_screencap_count_since_probe = 0;
+    m_adb_client = nullptr;
+    m_device_key.clear();
+#ifndef _WIN32
+    m_shm_frame_reader = nullptr;
+#endif
+    m_frame_stream = nullptr;
+    m_stream_port = 0;
+    m_session_recorder = nullptr;
+    m_session_replayer = nullptr;
 }
 
 void asst::Controller::close_socket() noexcept
@@ -879,13 +1418,42 @@ std::optional<unsigned short> asst::Controller::init_socket(const std::string& l
 
 bool asst::Controller::screencap(bool allow_reconnect)
 {
-    DecodeFunc decode_raw = [&](const std::string& data) -> bool {
-        if (data.empty()) {
-            return false;
+    std::unique_lock<std::mutex> screencap_lock(m_screencap_mutex);
+    const auto capture_start_time = std::chrono::steady_clock::now();
+
+    // 上一帧换下来的 Mat 直接拿来当解码目标，尺寸不变时 cvtColor / imdecode 不会重新分配内存。
+    // 如果外面还有人引用着它（浅拷贝），就不能往里面写了，放掉让 OpenCV 重新分配
+    auto prepare_back_image = [&]() {
+        if (m_screencap_back_image.u && m_screencap_back_image.u->refcount > 1) {
+            m_screencap_back_image.release();
         }
-        size_t std_size = 4ULL * m_width * m_height;
-        if (data.size() < std_size) {
-            return false;
+    };
+    auto swap_in_back_image = [&]() {
+        {
+            std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
+            cv::swap(m_cache_image, m_screencap_back_image);
+            ++m_frame_seq;
+            m_frame_time = capture_start_time;
+        }
+        m_frame_cv.notify_all();
+    };
+
+    if (m_session_replayer) {
+        m_screencap_back_image = m_session_replayer->next_frame();
+        if (m_screencap_back_image.empty()) {
+            return false;
+        }
+        swap_in_back_image();
+        return true;
+    }
+
+    auto decode_raw = [&](std::string_view data) -> bool {
+        if (data.empty()) {
+            return false;
+        }
+        size_t std_size = 4ULL * m_width * m_height;
+        if (data.size() < std_size) {
+            return false;
         }
         size_t header_size = data.size() - std_size;
         auto img_data_beg = data.cbegin() + header_size;
@@ -896,117 +1464,326 @@ bool asst::Controller::screencap(bool allow_reconnect)
         if (temp.empty()) {
             return false;
         }
-        cv::cvtColor(temp, temp, cv::COLOR_RGB2BGR);
-        std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
-        m_cache_image = temp;
+        prepare_back_image();
+        // 识别只用缩放到 m_scale_size 的图。没人要原分辨率的图时直接在 RGBA 上缩放，只转换缩小后的图，
+        // 省掉一整遍原分辨率的 cvtColor 和写一张原分辨率的 BGR。缩放是逐通道的，和先转换再缩放算出来一样
+        const cv::Size scale_size(m_scale_size.first, m_scale_size.second);
+        if (inited() && !m_session_recorder && !m_raw_image_requested && temp.size() != scale_size) {
+            cv::resize(temp, m_screencap_scaled_rgba, scale_size, 0.0, 0.0, cv::INTER_AREA);
+            cv::cvtColor(m_screencap_scaled_rgba, m_screencap_back_image, cv::COLOR_RGB2BGR);
+        }
+        else {
+            cv::cvtColor(temp, m_screencap_back_image, cv::COLOR_RGB2BGR);
+        }
+        swap_in_back_image();
         return true;
     };
 
     DecodeFunc decode_raw_with_gzip = [&](const std::string& data) -> bool {
-        const std::string raw_data = gzip::decompress(data.data(), data.size());
-        return decode_raw(raw_data);
+        gzip::Decompressor().decompress(m_screencap_inflate_buffer, data.data(), data.size());
+        return decode_raw(m_screencap_inflate_buffer);
+    };
+
+    // 数据已经在接收的过程中解压完了，流不完整或者解码失败的话再按原来的方式整块解压一次
+    DecodeFunc decode_inflated_stream = [&](const std::string& data) -> bool {
+        if (m_screencap_inflate_stream.finish() && decode_raw(m_screencap_inflate_stream.data())) {
+            return true;
+        }
+        return decode_raw_with_gzip(data);
+    };
+    PipeDataFunc inflate_pipe_data = [&](const char* data, size_t size) {
+        m_screencap_inflate_stream.feed(data, size);
     };
 
     DecodeFunc decode_encode = [&](const std::string& data) -> bool {
-        cv::Mat temp = cv::imdecode({ data.data(), int(data.size()) }, cv::IMREAD_COLOR);
-        if (temp.empty()) {
+        prepare_back_image();
+        cv::imdecode({ data.data(), int(data.size()) }, cv::IMREAD_COLOR, &m_screencap_back_image);
+        if (m_screencap_back_image.empty()) {
             return false;
         }
-        std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
-        m_cache_image = temp;
+        swap_in_back_image();
         return true;
     };
 
-    switch (m_adb.screencap_method) {
-    case AdbProperty::ScreencapMethod::UnknownYet: {
-        using namespace std::chrono;
-        Log.info("Try to find the fastest way to screencap");
-        auto min_cost = milliseconds(LLONG_MAX);
-        clear_lf_info();
+    using Method = AdbProperty::ScreencapMethod;
+    using namespace std::chrono;
 
-        auto start_time = high_resolution_clock::now();
-        if (m_support_socket && m_server_started &&
-            screencap(m_adb.screencap_raw_by_nc, decode_raw, allow_reconnect, true)) {
-            // sock 第一次截图比较长（不知道是不是初始化了什么东西耽误时间，减个额外的的时间）
-            auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start_time) - 100ms;
-            if (duration < min_cost) {
-                m_adb.screencap_method = AdbProperty::ScreencapMethod::RawByNc;
-                make_instance_inited(true);
-                min_cost = duration;
+    // 用指定的方式截一次图，不做统计
+    auto screencap_by = [&](Method method) -> bool {
+        switch (method) {
+        case Method::RawByNc:
+            return m_support_socket && m_server_started &&
+                   screencap(m_adb.screencap_raw_by_nc, decode_raw, allow_reconnect, true);
+        case Method::RawWithGzip: {
+            // 行尾还不确定的时候不知道要不要转换 CRLF，先整块收完再说
+            using EndOfLine = AdbProperty::ScreencapEndOfLine;
+            const auto eol = m_adb.screencap_end_of_line;
+            // 留点余量给 screencap 的头部，免得最后几个字节放不下又要扩容一倍
+            const size_t expected_size = 4ULL * m_width * m_height + 4096;
+            if ((eol == EndOfLine::LF || eol == EndOfLine::CRLF) &&
+                m_screencap_inflate_stream.begin(expected_size, eol == EndOfLine::CRLF)) {
+                return screencap(m_adb.screencap_raw_with_gzip, decode_inflated_stream, allow_reconnect, false,
+                                 inflate_pipe_data);
             }
-            Log.info("RawByNc cost", duration.count(), "ms");
+            return screencap(m_adb.screencap_raw_with_gzip, decode_raw_with_gzip, allow_reconnect);
+        }
+        case Method::Encode:
+            return screencap(m_adb.screencap_encode, decode_encode, allow_reconnect);
+        case Method::RawByAdbProtocol:
+            return m_adb_client && screencap_by_adb_protocol(decode_raw);
+#ifndef _WIN32
+        case Method::SharedMemory:
+            if (!m_shm_frame_reader) {
+                return false;
+            }
+            prepare_back_image();
+            {
+                // 等帧和转颜色在 read 里是一起的，都算成传输
+                LatencyHistogram::Scope latency_scope(latency(LatencyStage::Transfer));
+                if (!m_shm_frame_reader->read(m_screencap_back_image, m_width, m_height)) {
+                    return false;
+                }
+            }
+            swap_in_back_image();
+            return true;
+#endif
+        case Method::Stream:
+            if (!m_frame_stream) {
+                return false;
+            }
+            prepare_back_image();
+            {
+                LatencyHistogram::Scope latency_scope(latency(LatencyStage::Transfer));
+                if (!m_frame_stream->read(m_screencap_back_image)) {
+                    return false;
+                }
+            }
+            swap_in_back_image();
+            return true;
+        default:
+            return false;
+        }
+    };
+
+    // 不同方式的行尾和数据大小不一样，分开记，截图前换成对应方式的
+    auto load_method_props = [&](Method method) {
+        const auto& stats = m_screencap_stats[method];
+        m_adb.screencap_end_of_line = stats.end_of_line;
+        m_screencap_data_general_size = stats.data_general_size;
+    };
+    auto save_method_props = [&](Method method) {
+        auto& stats = m_screencap_stats[method];
+        stats.end_of_line = m_adb.screencap_end_of_line;
+        stats.data_general_size = m_screencap_data_general_size;
+    };
+
+    // 截一次图并记进这个方式的统计里
+    auto measure = [&](Method method, milliseconds extra_cost = 0ms) -> bool {
+        auto start_time = steady_clock::now();
+        bool ret = screencap_by(method);
+        auto cost = duration_cast<milliseconds>(steady_clock::now() - start_time) - extra_cost;
+
+        auto& stats = m_screencap_stats[method];
+        if (ret) {
+            // 指数滑动平均，偶尔的卡顿不至于让结果大起大落
+            constexpr double Alpha = 0.2;
+            stats.avg_cost =
+                stats.samples ? stats.avg_cost * (1 - Alpha) + static_cast<double>(cost.count()) * Alpha
+                              : static_cast<double>(cost.count());
+            ++stats.samples;
+            stats.consecutive_failures = 0;
+            save_method_props(method);
         }
         else {
-            Log.info("RawByNc is not supported");
+            ++stats.failures;
+            ++stats.consecutive_failures;
         }
-        clear_lf_info();
+        return ret;
+    };
 
-        start_time = high_resolution_clock::now();
-        if (screencap(m_adb.screencap_raw_with_gzip, decode_raw_with_gzip, allow_reconnect)) {
-            auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start_time);
-            if (duration < min_cost) {
-                m_adb.screencap_method = AdbProperty::ScreencapMethod::RawWithGzip;
-                make_instance_inited(true);
-                min_cost = duration;
+    // 在最近都成功、样本足够的方式里挑平均耗时最短的。
+    // min_samples 为 0 时连还没测过的（用的缓存结果）也算上，当成最慢的
+    auto fastest_method = [&](Method except = Method::UnknownYet, size_t min_samples = 3) -> Method {
+        Method best = Method::UnknownYet;
+        double best_cost = std::numeric_limits<double>::max();
+        for (const auto& [method, stats] : m_screencap_stats) {
+            if (method == except || !stats.supported || stats.consecutive_failures || stats.samples < min_samples) {
+                continue;
+            }
+            double cost = stats.samples ? stats.avg_cost : std::numeric_limits<double>::max();
+            if (best == Method::UnknownYet || cost < best_cost) {
+                best = method;
+                best_cost = cost;
             }
-            Log.info("RawWithGzip cost", duration.count(), "ms");
         }
-        else {
-            Log.info("RawWithGzip is not supported");
+        return best;
+    };
+
+    auto switch_method = [&](Method method) {
+        Log.info("Switch screencap method from", screencap_method_name(m_adb.screencap_method), "to",
+                 screencap_method_name(method));
+        m_adb.screencap_method = method;
+        load_method_props(method);
+        m_screencap_count_since_probe = 0;
+    };
+
+    auto log_stats = [&]() {
+        for (const auto& [method, stats] : m_screencap_stats) {
+            if (!stats.supported) {
+                continue;
+            }
+            Log.info("Screencap stats |", screencap_method_name(method), "| avg cost:", stats.avg_cost,
+                     "ms, samples:", stats.samples, ", failures:", stats.failures);
         }
-        clear_lf_info();
+    };
 
-        start_time = high_resolution_clock::now();
-        if (screencap(m_adb.screencap_encode, decode_encode, allow_reconnect)) {
-            auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start_time);
-            if (duration < min_cost) {
-                m_adb.screencap_method = AdbProperty::ScreencapMethod::Encode;
+    const Method current = m_adb.screencap_method;
+    if (current == Method::UnknownYet) {
+        Log.info("Try to find the fastest way to screencap");
+        double min_cost = std::numeric_limits<double>::max();
+        for (Method method : AllScreencapMethods) {
+            load_method_props(method);
+            // sock 第一次截图比较长（不知道是不是初始化了什么东西耽误时间，减个额外的的时间）
+            bool ret = measure(method, method == Method::RawByNc ? 100ms : 0ms);
+            auto& stats = m_screencap_stats[method];
+            stats.supported = ret;
+            if (!ret) {
+                Log.info(screencap_method_name(method), "is not supported");
+                continue;
+            }
+            Log.info(screencap_method_name(method), "cost", stats.avg_cost, "ms");
+            if (stats.avg_cost < min_cost) {
+                m_adb.screencap_method = method;
                 make_instance_inited(true);
-                min_cost = duration;
+                min_cost = stats.avg_cost;
             }
-            Log.info("Encode cost", duration.count(), "ms");
         }
-        else {
-            Log.info("Encode is not supported");
+        Log.info("The fastest way is", screencap_method_name(m_adb.screencap_method), ", cost:", min_cost, "ms");
+        load_method_props(m_adb.screencap_method);
+        m_screencap_count_since_probe = 0;
+        return m_adb.screencap_method != Method::UnknownYet;
+    }
+
+    bool ret = measure(current);
+    if (!ret && (current == Method::RawByAdbProtocol || current == Method::SharedMemory ||
+                 current == Method::Stream)) {
+        // adb server、本机的截图 agent 或者设备上的 emitter 挂了的话，这一帧先用别的能用的方式截，
+        // 是 adb 命令的话顺便走一下重连流程。不管样本够不够，连接时测过能用就行
+        if (Method fallback = fastest_method(current, 0); fallback != Method::UnknownYet) {
+            load_method_props(fallback);
+            ret = screencap_by(fallback);
+            save_method_props(fallback);
+            load_method_props(current);
         }
-        static const std::unordered_map<AdbProperty::ScreencapMethod, std::string> MethodName = {
-            { AdbProperty::ScreencapMethod::UnknownYet, "UnknownYet" },
-            { AdbProperty::ScreencapMethod::RawByNc, "RawByNc" },
-            { AdbProperty::ScreencapMethod::RawWithGzip, "RawWithGzip" },
-            { AdbProperty::ScreencapMethod::Encode, "Encode" },
-        };
-        Log.info("The fastest way is", MethodName.at(m_adb.screencap_method), ", cost:", min_cost.count(), "ms");
-        clear_lf_info();
-        return m_adb.screencap_method != AdbProperty::ScreencapMethod::UnknownYet;
-    } break;
-    case AdbProperty::ScreencapMethod::RawByNc: {
-        return screencap(m_adb.screencap_raw_by_nc, decode_raw, allow_reconnect, true);
-    } break;
-    case AdbProperty::ScreencapMethod::RawWithGzip: {
-        return screencap(m_adb.screencap_raw_with_gzip, decode_raw_with_gzip, allow_reconnect);
-    } break;
-    case AdbProperty::ScreencapMethod::Encode: {
-        return screencap(m_adb.screencap_encode, decode_encode, allow_reconnect);
-    } break;
     }
 
+    // 当前方式连续失败，换一个最近还能用的。其他方式只有连接时和每次重新测速时各测一次，
+    // 刚连上的一段时间里样本都不够，这里不要求样本数
+    static constexpr int MaxConsecutiveFailures = 3;
+    if (m_screencap_stats[current].consecutive_failures >= MaxConsecutiveFailures) {
+        if (Method alternative = fastest_method(current, 0); alternative != Method::UnknownYet) {
+            switch_method(alternative);
+            log_stats();
+        }
+    }
+    if (!ret) {
+        return false;
+    }
+
+    // 模拟器负载会变，每隔一段时间把其他能用的方式也各测一次，明显更快的话就换过去
+    static constexpr size_t ReprobeInterval = 100;
+    if (++m_screencap_count_since_probe < ReprobeInterval) {
+        return true;
+    }
+    m_screencap_count_since_probe = 0;
+
+    for (Method method : AllScreencapMethods) {
+        if (method == current || !m_screencap_stats[method].supported) {
+            continue;
+        }
+        load_method_props(method);
+        measure(method);
+    }
+    load_method_props(current);
+    log_stats();
+
+    // 要快出两成以上才换，免得在差不多的方式之间来回跳
+    static constexpr double SwitchRatio = 0.8;
+    Method fastest = fastest_method();
+    if (fastest != Method::UnknownYet && fastest != current &&
+        m_screencap_stats[fastest].avg_cost < m_screencap_stats[current].avg_cost * SwitchRatio) {
+        switch_method(fastest);
+    }
+    return true;
+}
+
+bool asst::Controller::use_cached_screencap_method(const DeviceRegistry::DeviceProps& props)
+{
+    using Method = AdbProperty::ScreencapMethod;
+    auto method_by_name = [](const std::string& name) -> Method {
+        for (Method method : AllScreencapMethods) {
+            if (screencap_method_name(method) == name) {
+                return method;
+            }
+        }
+        return Method::UnknownYet;
+    };
+
+    const Method cached = method_by_name(props.screencap_method);
+    if (cached == Method::UnknownYet) {
+        return false;
+    }
+    // 其他能用的方式也标上，定期重新测速时还能换过去
+    for (const auto& name : props.screencap_supported_methods) {
+        if (Method method = method_by_name(name); method != Method::UnknownYet) {
+            m_screencap_stats[method].supported = true;
+        }
+    }
+    m_screencap_stats[cached].supported = true;
+    m_adb.screencap_method = cached;
+
+    // 缓存的方式失败时 screencap 可能回退到别的方式截成功了，要看这个方式自己有没有失败
+    if (screencap() && m_screencap_stats[cached].consecutive_failures == 0) {
+        Log.info("Use cached screencap method", props.screencap_method);
+        return true;
+    }
+    Log.info("Cached screencap method", props.screencap_method, "is not available, find again");
+    m_screencap_stats.clear();
+    m_adb.screencap_method = Method::UnknownYet;
+    m_screencap_count_since_probe = 0;
     return false;
 }
 
+const std::string& asst::Controller::screencap_method_name(AdbProperty::ScreencapMethod method)
+{
+    static const std::unordered_map<AdbProperty::ScreencapMethod, std::string> MethodName = {
+        { AdbProperty::ScreencapMethod::UnknownYet, "UnknownYet" },
+        { AdbProperty::ScreencapMethod::RawByNc, "RawByNc" },
+        { AdbProperty::ScreencapMethod::RawWithGzip, "RawWithGzip" },
+        { AdbProperty::ScreencapMethod::Encode, "Encode" },
+        { AdbProperty::ScreencapMethod::RawByAdbProtocol, "RawByAdbProtocol" },
+        { AdbProperty::ScreencapMethod::SharedMemory, "SharedMemory" },
+        { AdbProperty::ScreencapMethod::Stream, "Stream" },
+    };
+    return MethodName.at(method);
+}
+
 bool asst::Controller::screencap(const std::string& cmd, const DecodeFunc& decode_func, bool allow_reconnect,
-                                 bool by_socket)
+                                 bool by_socket, const PipeDataFunc& pipe_data_func)
 {
     if ((!m_support_socket || !m_server_started) && by_socket) [[unlikely]] {
         return false;
     }
 
-    auto ret = call_command(cmd, 20000, allow_reconnect, by_socket);
+    auto ret = call_command(cmd, 20000, allow_reconnect, by_socket, std::move(m_screencap_buffer), pipe_data_func);
 
     if (!ret || ret.value().empty()) [[unlikely]] {
         Log.error("data is empty!");
         return false;
     }
-    auto& data = ret.value();
+    // 放回成员里，下一帧接着复用这块内存
+    m_screencap_buffer = std::move(ret.value());
+    auto& data = m_screencap_buffer;
     if (m_screencap_data_general_size && data.size() < m_screencap_data_general_size * 0.1) {
         Log.error("data is too small!");
         return false;
@@ -1015,13 +1792,19 @@ bool asst::Controller::screencap(const std::string& cmd, const DecodeFunc& decod
     bool tried_conversion = false;
     if (m_adb.screencap_end_of_line == AdbProperty::ScreencapEndOfLine::CRLF) {
         tried_conversion = true;
-        if (!convert_lf(data)) [[unlikely]] { // 没找到 "\r\n"
+        auto convert_start_time = std::chrono::steady_clock::now();
+        bool converted = convert_lf(data);
+        latency(LatencyStage::ConvertLf).record(std::chrono::steady_clock::now() - convert_start_time);
+        if (!converted) [[unlikely]] { // 没找到 "\r\n"
             Log.info("screencap_end_of_line is set to CRLF but no `\\r\\n` found, set it to LF");
             m_adb.screencap_end_of_line = AdbProperty::ScreencapEndOfLine::LF;
         }
     }
 
-    if (decode_func(data)) [[likely]] {
+    auto decode_start_time = std::chrono::steady_clock::now();
+    bool decoded = decode_func(data);
+    latency(LatencyStage::Decode).record(std::chrono::steady_clock::now() - decode_start_time);
+    if (decoded) [[likely]] {
         if (m_adb.screencap_end_of_line == AdbProperty::ScreencapEndOfLine::UnknownYet) [[unlikely]] {
             Log.info("screencap_end_of_line is LF");
             m_adb.screencap_end_of_line = AdbProperty::ScreencapEndOfLine::LF;
@@ -1057,6 +1840,37 @@ bool asst::Controller::screencap(const std::string& cmd, const DecodeFunc& decod
     return true;
 }
 
+bool asst::Controller::screencap_by_adb_protocol(const DecodeFunc& decode_func)
+{
+    if (!m_adb_client || m_adb.screencap_raw_by_adb_protocol.empty()) [[unlikely]] {
+        return false;
+    }
+
+    // exec: 服务是二进制透传的，不存在 CRLF 的问题
+    auto transfer_start_time = std::chrono::steady_clock::now();
+    auto ret = m_adb_client->exec(m_adb.screencap_raw_by_adb_protocol, 20000, std::move(m_screencap_buffer));
+    latency(LatencyStage::Transfer).record(std::chrono::steady_clock::now() - transfer_start_time);
+    if (!ret || ret.value().empty()) [[unlikely]] {
+        Log.error("data is empty!");
+        return false;
+    }
+    m_screencap_buffer = std::move(ret.value());
+    auto& data = m_screencap_buffer;
+    if (m_screencap_data_general_size && data.size() < m_screencap_data_general_size * 0.1) {
+        Log.error("data is too small!");
+        return false;
+    }
+    auto decode_start_time = std::chrono::steady_clock::now();
+    bool decoded = decode_func(data);
+    latency(LatencyStage::Decode).record(std::chrono::steady_clock::now() - decode_start_time);
+    if (!decoded) {
+        Log.error("decode failed!");
+        return false;
+    }
+    m_screencap_data_general_size = data.size();
+    return true;
+}
+
 void asst::Controller::clear_lf_info()
 {
     m_adb.screencap_end_of_line = AdbProperty::ScreencapEndOfLine::UnknownYet;
@@ -1071,11 +1885,114 @@ cv::Mat asst::Controller::get_resized_image_cache() const
         Log.error("image is empty");
         return { d_size, CV_8UC3 };
     }
+    const size_t seq = m_frame_seq;
     cv::Mat resized_mat;
-    cv::resize(m_cache_image, resized_mat, d_size, 0.0, 0.0, cv::INTER_AREA);
+    // 设备分辨率本来就是 m_scale_size 的话不用缩放，直接浅拷贝出去（截图那边发现有人引用着就不会往里面写）
+    if (m_cache_image.size() == d_size) {
+        ++m_resize_cache_hits;
+        resized_mat = m_cache_image;
+    }
+    else {
+        std::unique_lock<std::mutex> resized_lock(m_resized_image_mutex);
+        if (m_resized_image_seq == seq && !m_resized_image.empty()) {
+            ++m_resize_cache_hits;
+        }
+        else {
+            ++m_resize_cache_misses;
+            // 上一帧缩放出来的图还有人拿着的话不能覆盖，放掉重新分配
+            if (m_resized_image.u && m_resized_image.u->refcount > 1) {
+                m_resized_image.release();
+            }
+            LatencyHistogram::Scope latency_scope(latency(LatencyStage::Resize));
+            cv::resize(m_cache_image, m_resized_image, d_size, 0.0, 0.0, cv::INTER_AREA);
+            m_resized_image_seq = seq;
+        }
+        resized_mat = m_resized_image;
+    }
+    image_lock.unlock();
+
+    record_frame_thumbnail(seq, resized_mat);
+    m_image_seq = seq;
     return resized_mat;
 }
 
+void asst::Controller::record_frame_thumbnail(size_t seq, const cv::Mat& image) const
+{
+    std::unique_lock<std::mutex> thumbnail_lock(m_thumbnail_mutex);
+    if (!m_frame_thumbnails.empty() && m_frame_thumbnails.back().first == seq) {
+        return;
+    }
+    cv::Mat gray;
+    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    cv::Mat thumbnail;
+    cv::resize(gray, thumbnail, cv::Size(gray.cols / FrameThumbnailScale, gray.rows / FrameThumbnailScale), 0.0, 0.0,
+               cv::INTER_AREA);
+    m_frame_thumbnails.emplace_back(seq, std::move(thumbnail));
+    while (m_frame_thumbnails.size() > FrameThumbnailCount) {
+        m_frame_thumbnails.pop_front();
+    }
+}
+
+size_t asst::Controller::get_image_seq() const noexcept
+{
+    return m_image_seq;
+}
+
+bool asst::Controller::frame_changed(size_t since_seq, const Rect& roi, bool exact) const
+{
+    // 分块比较平均灰度差，块边长是缩略图上的像素数；只要有一块差得多就算变了，不会被大片的静止区域稀释
+    static constexpr int BlockSize = 8;
+    static constexpr double ChangedThreshold = 8.0;
+
+    const size_t cur_seq = m_image_seq;
+    if (cur_seq == since_seq) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> thumbnail_lock(m_thumbnail_mutex);
+    auto find_thumbnail = [&](size_t seq) -> const cv::Mat* {
+        for (const auto& [thumbnail_seq, thumbnail] : m_frame_thumbnails) {
+            if (thumbnail_seq == seq) {
+                return &thumbnail;
+            }
+        }
+        return nullptr;
+    };
+    const cv::Mat* cur = find_thumbnail(cur_seq);
+    const cv::Mat* since = find_thumbnail(since_seq);
+    if (!cur || !since || cur->size() != since->size()) {
+        return true;
+    }
+
+    cv::Rect thumbnail_roi(0, 0, cur->cols, cur->rows);
+    if (roi.width > 0 && roi.height > 0) {
+        cv::Rect scaled_roi(roi.x / FrameThumbnailScale, roi.y / FrameThumbnailScale,
+                            (roi.width + FrameThumbnailScale - 1) / FrameThumbnailScale,
+                            (roi.height + FrameThumbnailScale - 1) / FrameThumbnailScale);
+        thumbnail_roi &= scaled_roi;
+    }
+    if (thumbnail_roi.empty()) {
+        return true;
+    }
+
+    cv::Mat diff;
+    cv::absdiff((*cur)(thumbnail_roi), (*since)(thumbnail_roi), diff);
+    thumbnail_lock.unlock();
+
+    if (exact) {
+        return cv::countNonZero(diff) != 0;
+    }
+
+    // INTER_AREA 缩小正好就是求每个块的平均值
+    cv::Mat block_mean;
+    cv::resize(diff, block_mean,
+               cv::Size((diff.cols + BlockSize - 1) / BlockSize, (diff.rows + BlockSize - 1) / BlockSize), 0.0, 0.0,
+               cv::INTER_AREA);
+    double max_mean = 0;
+    cv::minMaxLoc(block_mean, nullptr, &max_mean);
+    return max_mean > ChangedThreshold;
+}
+
 bool asst::Controller::start_game(const std::string& client_type)
 {
     if (client_type.empty()) {
@@ -1086,11 +2003,19 @@ bool asst::Controller::start_game(const std::string& client_type)
         return false;
     }
     std::string cur_cmd = utils::string_replace_all(m_adb.start, "[Intent]", intent_name.value());
+    InputGuard input_guard(this);
+    if (replay_or_record_input(json::object { { "type", "start_game" }, { "client_type", client_type } })) {
+        return true;
+    }
     return call_command(cur_cmd).has_value();
 }
 
 bool asst::Controller::stop_game()
 {
+    InputGuard input_guard(this);
+    if (replay_or_record_input(json::object { { "type", "stop_game" } })) {
+        return true;
+    }
     return call_command(m_adb.stop).has_value();
 }
 
@@ -1110,9 +2035,14 @@ bool asst::Controller::click(const Rect& rect)
 
 bool asst::Controller::click_without_scale(const Point& p)
 {
+    InputGuard input_guard(this);
+    LatencyHistogram::Scope latency_scope(latency(LatencyStage::Click));
     if (p.x < 0 || p.x >= m_width || p.y < 0 || p.y >= m_height) {
         Log.error("click point out of range");
     }
+    if (replay_or_record_input(json::object { { "type", "click" }, { "x", p.x }, { "y", p.y } })) {
+        return true;
+    }
 
     if (m_minitouch_enabled && m_minitouch_available) {
         Log.info(m_use_maa_touch ? "maatouch" : "minitouch", "click:", p);
@@ -1153,6 +2083,8 @@ bool asst::Controller::swipe(const Rect& r1, const Rect& r2, int duration, bool
 bool asst::Controller::swipe_without_scale(const Point& p1, const Point& p2, int duration, bool extra_swipe,
                                            double slope_in, double slope_out, bool with_pause)
 {
+    InputGuard input_guard(this);
+    LatencyHistogram::Scope latency_scope(latency(LatencyStage::Swipe));
     int x1 = p1.x, y1 = p1.y;
     int x2 = p2.x, y2 = p2.y;
 
@@ -1162,6 +2094,16 @@ bool asst::Controller::swipe_without_scale(const Point& p1, const Point& p2, int
         x1 = std::clamp(x1, 0, m_width - 1);
         y1 = std::clamp(y1, 0, m_height - 1);
     }
+    if (replay_or_record_input(json::object {
+            { "type", "swipe" },
+            { "x1", x1 },
+            { "y1", y1 },
+            { "x2", x2 },
+            { "y2", y2 },
+            { "duration", duration },
+        })) {
+        return true;
+    }
 
     const auto& opt = Config.get_options();
     if (m_minitouch_enabled && m_minitouch_available) {
@@ -1195,7 +2137,8 @@ bool asst::Controller::swipe_without_scale(const Point& p1, const Point& p2, int
                         toucher.key_up(EscKeyCode, 0);
                     }
                     else {
-                        pause_future = std::async(std::launch::async, [&]() { press_esc(); });
+                        // 这个 esc 是滑动的一部分，不走 press_esc，免得在输入线程上和自己互相等待
+                        pause_future = std::async(std::launch::async, [&]() { call_command(m_adb.press_esc); });
                     }
                 }
                 if (cur_x < 0 || cur_x > m_minitouch_props.max_x || cur_y < 0 || cur_y > m_minitouch_props.max_y) {
@@ -1256,10 +2199,106 @@ bool asst::Controller::swipe_without_scale(const Rect& r1, const Rect& r2, int d
 bool asst::Controller::press_esc()
 {
     LogTraceFunction;
+    InputGuard input_guard(this);
+    if (replay_or_record_input(json::object { { "type", "press_esc" } })) {
+        return true;
+    }
 
     return call_command(m_adb.press_esc).has_value();
 }
 
+std::future<bool> asst::Controller::click_async(const Point& p)
+{
+    return post_input([this, p]() { return click(p); });
+}
+
+std::future<bool> asst::Controller::click_async(const Rect& rect)
+{
+    // 随机数引擎不是线程安全的，在调用方线程里先把点取好
+    return click_async(rand_point_in_rect(rect));
+}
+
+std::future<bool> asst::Controller::swipe_async(const Point& p1, const Point& p2, int duration, bool extra_swipe,
+                                                double slope_in, double slope_out, bool with_pause)
+{
+    return post_input([=, this]() { return swipe(p1, p2, duration, extra_swipe, slope_in, slope_out, with_pause); });
+}
+
+std::future<bool> asst::Controller::press_esc_async()
+{
+    return post_input([this]() { return press_esc(); });
+}
+
+std::future<bool> asst::Controller::post_input(std::function<bool()> func)
+{
+    std::unique_lock<std::mutex> lock(m_input_mutex);
+    if (!m_input_thread.joinable()) {
+        m_input_exit = false;
+        m_input_thread = std::thread(&Controller::input_proc, this);
+    }
+    auto& request = m_input_queue.emplace_back(InputRequest { std::move(func), {} });
+    auto future = request.promise.get_future();
+    ++m_pending_inputs;
+    lock.unlock();
+    m_input_cv.notify_all();
+    return future;
+}
+
+void asst::Controller::wait_for_input_queue()
+{
+    std::unique_lock<std::mutex> lock(m_input_mutex);
+    // 输入线程自己执行输入的时候不能等自己
+    if (std::this_thread::get_id() == m_input_thread.get_id()) {
+        return;
+    }
+    m_input_cv.wait(lock, [&]() { return m_input_exit || (m_input_queue.empty() && !m_input_busy); });
+}
+
+void asst::Controller::stop_input_thread()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_input_mutex);
+        m_input_exit = true;
+    }
+    m_input_cv.notify_all();
+    if (m_input_thread.joinable()) {
+        m_input_thread.join();
+    }
+    std::unique_lock<std::mutex> lock(m_input_mutex);
+    // 没来得及执行的输入直接算失败
+    for (auto& request : m_input_queue) {
+        request.promise.set_value(false);
+    }
+    m_pending_inputs -= m_input_queue.size();
+    m_input_queue.clear();
+}
+
+void asst::Controller::input_proc()
+{
+    LogTraceFunction;
+
+    std::unique_lock<std::mutex> lock(m_input_mutex);
+    while (true) {
+        m_input_cv.wait(lock, [&]() { return m_input_exit || !m_input_queue.empty(); });
+        if (m_input_exit) {
+            break;
+        }
+        InputRequest request = std::move(m_input_queue.front());
+        m_input_queue.pop_front();
+        m_input_busy = true;
+        lock.unlock();
+
+        // 同步输入的 InputGuard 析构时已经记下了结束时间，这之后再减，预取那边看到 0 时时间一定是新的
+        bool ret = request.func();
+        --m_pending_inputs;
+        request.promise.set_value(ret);
+
+        lock.lock();
+        m_input_busy = false;
+        m_input_cv.notify_all();
+    }
+}
+
 bool asst::Controller::support_swipe_with_pause() const noexcept
 {
     return m_minitouch_enabled && m_minitouch_available && m_swipe_with_pause_enabled && !m_adb.press_esc.empty();
@@ -1269,7 +2308,11 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
 {
     LogTraceFunction;
 
+    stop_input_thread();
+    stop_prefetch();
     release_minitouch();
+    release_shell_session();
+    release_frame_stream();
     clear_info();
 
 #ifdef ASST_DEBUG
@@ -1291,7 +2334,35 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
         };
     };
 
-    auto adb_ret = Config.get_adb_cfg(config);
+    // 录制和回放通过 config 的前缀选择：
+    //   "Replay:<目录>"          不连设备，回放录好的会话，adb_path 和 address 会被忽略
+    //   "Record:<配置名>:<目录>"  按 <配置名> 正常连接，同时把每一帧和输入录到 <目录> 里
+    static constexpr std::string_view ReplayPrefix = "Replay:";
+    static constexpr std::string_view RecordPrefix = "Record:";
+    if (config.starts_with(ReplayPrefix)) {
+        return connect_replay(config.substr(ReplayPrefix.size()), get_info_json);
+    }
+
+    std::string adb_config = config;
+    if (config.starts_with(RecordPrefix)) {
+        std::string record_params = config.substr(RecordPrefix.size());
+        size_t pos = record_params.find(':');
+        if (pos != std::string::npos) {
+            adb_config = record_params.substr(0, pos);
+            m_session_recorder = std::make_unique<SessionRecorder>(utils::path(record_params.substr(pos + 1)));
+        }
+        if (!m_session_recorder || !m_session_recorder->open()) {
+            m_session_recorder = nullptr;
+            json::value info = get_info_json() | json::object {
+                { "what", "ConnectFailed" },
+                { "why", "RecordSessionFailed" },
+            };
+            callback(AsstMsg::ConnectionInfo, info);
+            return false;
+        }
+    }
+
+    auto adb_ret = Config.get_adb_cfg(adb_config);
     if (!adb_ret) {
         json::value info = get_info_json() | json::object {
             { "what", "ConnectFailed" },
@@ -1321,17 +2392,37 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
         return false;
     }
 
+    // 同一台设备同时只让一个实例走连接流程，后面的实例直接用前面查到的属性，不用再挨个执行命令
+    auto& registry = DeviceRegistry::get_instance();
+    m_device_key = DeviceRegistry::make_key(adb_path, address, adb_config);
+    auto device_lock = registry.lock_device(m_device_key);
+    const auto cached_props = registry.get_props(m_device_key);
+    auto props = cached_props.value_or(DeviceRegistry::DeviceProps {});
+    if (cached_props) {
+        Log.info("use cached device props of", address);
+    }
+
     /* connect */
     {
         m_adb.connect = cmd_replace(adb_cfg.connect);
-        auto connect_ret = call_command(m_adb.connect, 60LL * 1000, false /* adb 连接时不允许重试 */);
         bool is_connect_success = false;
-        if (connect_ret) {
-            auto& connect_str = connect_ret.value();
-            is_connect_success = connect_str.find("error") == std::string::npos;
-            if (connect_str.find("daemon started successfully") != std::string::npos &&
-                connect_str.find("daemon still not running") == std::string::npos) {
-                m_adb_release = cmd_replace(adb_cfg.release);
+        if (registry.recently_connected(m_device_key)) {
+            Log.info(address, "is connected just now, skip connect command");
+            is_connect_success = true;
+        }
+        else {
+            auto server_lock = registry.lock_server_if_cold(adb_path);
+            auto connect_ret = call_command(m_adb.connect, 60LL * 1000, false /* adb 连接时不允许重试 */);
+            if (connect_ret) {
+                auto& connect_str = connect_ret.value();
+                is_connect_success = connect_str.find("error") == std::string::npos;
+                if (connect_str.find("daemon started successfully") != std::string::npos &&
+                    connect_str.find("daemon still not running") == std::string::npos) {
+                    m_adb_release = cmd_replace(adb_cfg.release);
+                }
+            }
+            if (is_connect_success) {
+                registry.mark_connected(adb_path, m_device_key);
             }
         }
         if (!is_connect_success) {
@@ -1349,7 +2440,10 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
     }
 
     /* get uuid (imei) */
-    {
+    if (cached_props) {
+        m_uuid = cached_props->uuid;
+    }
+    else {
         auto uuid_ret = call_command(cmd_replace(adb_cfg.uuid), 20000, false /* adb 连接时不允许重试 */);
         if (!uuid_ret) {
             json::value info = get_info_json() | json::object {
@@ -1363,6 +2457,9 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
         auto& uuid_str = uuid_ret.value();
         std::erase_if(uuid_str, [](char c) { return !std::isdigit(c) && !std::isalpha(c); });
         m_uuid = std::move(uuid_str);
+    }
+    props.uuid = m_uuid;
+    {
 
         json::value info = get_info_json() | json::object {
             { "what", "UuidGot" },
@@ -1377,7 +2474,10 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
     }
 
     // 按需获取display ID 信息
-    if (!adb_cfg.display_id.empty()) {
+    if (cached_props) {
+        display_id = cached_props->display_id;
+    }
+    else if (!adb_cfg.display_id.empty()) {
         auto display_id_ret = call_command(cmd_replace(adb_cfg.display_id));
         if (!display_id_ret) {
             return false;
@@ -1399,24 +2499,34 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
         return false;
     }
 
+    props.display_id = display_id;
+
     /* display */
     {
-        auto display_ret = call_command(cmd_replace(adb_cfg.display));
-        if (!display_ret) {
-            json::value info = get_info_json() | json::object {
-                { "what", "ConnectFailed" },
-                { "why", "Display command failed to exec" },
-            };
-            callback(AsstMsg::ConnectionInfo, info);
-            return false;
+        if (cached_props) {
+            m_width = cached_props->width;
+            m_height = cached_props->height;
         }
-        std::stringstream display_ss(display_ret.value());
-        int size_value1 = 0;
-        int size_value2 = 0;
-        display_ss >> size_value1 >> size_value2;
+        else {
+            auto display_ret = call_command(cmd_replace(adb_cfg.display));
+            if (!display_ret) {
+                json::value info = get_info_json() | json::object {
+                    { "what", "ConnectFailed" },
+                    { "why", "Display command failed to exec" },
+                };
+                callback(AsstMsg::ConnectionInfo, info);
+                return false;
+            }
+            std::stringstream display_ss(display_ret.value());
+            int size_value1 = 0;
+            int size_value2 = 0;
+            display_ss >> size_value1 >> size_value2;
 
-        m_width = (std::max)(size_value1, size_value2);
-        m_height = (std::min)(size_value1, size_value2);
+            m_width = (std::max)(size_value1, size_value2);
+            m_height = (std::min)(size_value1, size_value2);
+        }
+        props.width = m_width;
+        props.height = m_height;
 
         json::value info = get_info_json() | json::object {
             { "what", "ResolutionGot" },
@@ -1455,24 +2565,7 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
         return false;
     }
 
-    /* calc ratio */
-    {
-        constexpr double DefaultRatio =
-            static_cast<double>(WindowWidthDefault) / static_cast<double>(WindowHeightDefault);
-        double cur_ratio = static_cast<double>(m_width) / static_cast<double>(m_height);
-
-        if (cur_ratio >= DefaultRatio // 说明是宽屏或默认16:9，按照高度计算缩放
-            || std::fabs(cur_ratio - DefaultRatio) < DoubleDiff) {
-            int scale_width = static_cast<int>(cur_ratio * WindowHeightDefault);
-            m_scale_size = std::make_pair(scale_width, WindowHeightDefault);
-            m_control_scale = static_cast<double>(m_height) / static_cast<double>(WindowHeightDefault);
-        }
-        else { // 否则可能是偏正方形的屏幕，按宽度计算
-            int scale_height = static_cast<int>(WindowWidthDefault / cur_ratio);
-            m_scale_size = std::make_pair(WindowWidthDefault, scale_height);
-            m_control_scale = static_cast<double>(m_width) / static_cast<double>(WindowWidthDefault);
-        }
-    }
+    calc_scale_size();
 
     {
         json::value info = get_info_json() | json::object {
@@ -1490,6 +2583,27 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
     m_adb_release = m_adb.release = cmd_replace(adb_cfg.release);
     m_adb.start = cmd_replace(adb_cfg.start);
     m_adb.stop = cmd_replace(adb_cfg.stop);
+    m_adb.shell_session = cmd_replace(adb_cfg.shell_session);
+    m_adb.screencap_raw_by_adb_protocol = cmd_replace(adb_cfg.screencap_raw_by_adb_protocol);
+    m_adb.screencap_shared_memory = cmd_replace(adb_cfg.screencap_shared_memory);
+
+    if (!adb_cfg.adb_server.empty()) {
+        m_adb_client = registry.get_adb_client(address, adb_cfg.adb_server);
+        if (!m_adb_client) {
+            Log.info("adb server is not available, fallback to adb command");
+        }
+    }
+
+#ifndef _WIN32
+    if (!m_adb.screencap_shared_memory.empty()) {
+        // agent 不一定已经起来了，第一次截图时才去映射
+        m_shm_frame_reader = std::make_unique<ShmFrameReader>(m_adb.screencap_shared_memory);
+    }
+#endif
+
+    if (!m_adb.shell_session.empty() && !call_and_hup_shell_session()) {
+        Log.info("shell session is not available, fallback to spawn");
+    }
 
     if (m_support_socket && !m_server_started) {
         std::string bind_address;
@@ -1528,11 +2642,15 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
     while (m_minitouch_enabled) {
         m_minitouch_available = false;
 
-        std::string_view touch_program;
+        std::string touch_program;
         if (m_use_maa_touch) {
             touch_program = "maatouch";
             m_minitouch_props.orientation = 0;
         }
+        else if (cached_props && !cached_props->minitouch_abi.empty()) {
+            touch_program = cached_props->minitouch_abi;
+            m_minitouch_props.orientation = cached_props->orientation;
+        }
         else {
             std::string abilist = call_command(cmd_replace(adb_cfg.abilist)).value_or(std::string());
             for (const auto& abi : Config.get_options().minitouch_programs_order) {
@@ -1564,14 +2682,34 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
                 });
         };
 
-        if (!call_command(minitouch_cmd_rep(adb_cfg.push_minitouch))) break;
-        if (!call_command(minitouch_cmd_rep(adb_cfg.chmod_minitouch))) break;
+        auto push_touch_program = [&]() -> bool {
+            bool pushed = false;
+            if (m_adb_client) {
+                using namespace asst::utils::path_literals;
+                pushed = m_adb_client->push(ResDir.get() / "minitouch"_p / touch_program / "minitouch"_p,
+                                            "/data/local/tmp/" + m_uuid, 0700);
+            }
+            if (!pushed && !call_command(minitouch_cmd_rep(adb_cfg.push_minitouch))) return false;
+            return call_command(minitouch_cmd_rep(adb_cfg.chmod_minitouch)).has_value();
+        };
+
+        // 前面的实例已经推过同一个程序的话，设备上的文件还在，不用再推
+        bool pushed_before = cached_props && cached_props->pushed_touch_program == touch_program;
+        if (!pushed_before && !push_touch_program()) break;
 
         m_adb.call_minitouch = minitouch_cmd_rep(adb_cfg.call_minitouch);
         m_adb.call_maatouch = minitouch_cmd_rep(adb_cfg.call_maatouch);
 
-        if (!call_and_hup_minitouch()) break;
+        if (!call_and_hup_minitouch()) {
+            // 缓存可能过时了（比如模拟器重启后清掉了文件），重新推一遍再试
+            if (!pushed_before || !push_touch_program() || !call_and_hup_minitouch()) break;
+        }
 
+        if (!m_use_maa_touch) {
+            props.minitouch_abi = touch_program;
+            props.orientation = m_minitouch_props.orientation;
+        }
+        props.pushed_touch_program = touch_program;
         m_minitouch_available = true;
         break;
     };
@@ -1585,15 +2723,137 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
         return false;
     }
 
+    if (need_exit()) {
+        return false;
+    }
+
+    // 和 minitouch 一样按 abi 把 emitter 推到设备上起起来，起不来的话只是少一种截图方式。
+    // 还没有随资源发布设备上的 emitter，默认配置里没有 callStreamEmitter，要用的话在自己的配置里加上。
+    // pushStreamEmitter 为空时不推，直接执行 callStreamEmitter，在本机用 tools/FrameStreamEmitter 测试时就是这样
+    if (!adb_cfg.call_stream_emitter.empty()) {
+        const bool need_push = !adb_cfg.push_stream_emitter.empty();
+        std::string abi = props.minitouch_abi;
+        if (need_push && abi.empty()) {
+            std::string abilist = call_command(cmd_replace(adb_cfg.abilist)).value_or(std::string());
+            for (const auto& item : Config.get_options().minitouch_programs_order) {
+                if (abilist.find(item) != std::string::npos) {
+                    abi = item;
+                    break;
+                }
+            }
+        }
+
+        using namespace asst::utils::path_literals;
+        const auto local_path = ResDir.get() / "stream_emitter"_p / utils::path(abi) / "stream_emitter"_p;
+        const std::string working_file = m_uuid + "_stream";
+        auto stream_cmd_rep = [&](const std::string& cfg_cmd) -> std::string {
+            return utils::string_replace_all(
+                cmd_replace(cfg_cmd),
+                {
+                    { "[streamEmitterLocalPath]", utils::path_to_utf8_string(local_path) },
+                    { "[streamEmitterWorkingFile]", working_file },
+                });
+        };
+
+        bool ready = false;
+        if (!need_push) {
+            ready = true;
+        }
+        else if (abi.empty() || !std::filesystem::exists(local_path)) {
+            Log.info("stream emitter is not available for abi", abi);
+        }
+        else {
+            bool pushed = m_adb_client && m_adb_client->push(local_path, "/data/local/tmp/" + working_file, 0700);
+            pushed = pushed || call_command(stream_cmd_rep(adb_cfg.push_stream_emitter));
+            ready = pushed && call_command(stream_cmd_rep(adb_cfg.chmod_stream_emitter));
+        }
+        if (ready) {
+            m_adb.call_stream_emitter = stream_cmd_rep(adb_cfg.call_stream_emitter);
+            m_adb.forward_stream = stream_cmd_rep(adb_cfg.forward_stream);
+            m_adb.remove_forward_stream = stream_cmd_rep(adb_cfg.remove_forward_stream);
+            if (!call_and_hup_frame_stream()) {
+                Log.info("stream emitter failed to start");
+                m_adb.call_stream_emitter.clear();
+            }
+        }
+    }
+
+    // 前面的实例测过的话直接用它测出来的方式，截一张确认能用；不能用了再重新测一遍
+    if (cached_props && use_cached_screencap_method(*cached_props)) {
+        make_instance_inited(true);
+    }
     // try to find the fastest way
-    if (!screencap()) {
+    else if (!screencap()) {
         Log.error("Cannot find a proper way to screencap!");
         return false;
     }
 
+    props.screencap_method = screencap_method_name(m_adb.screencap_method);
+    props.screencap_supported_methods.clear();
+    for (const auto& [method, stats] : m_screencap_stats) {
+        if (stats.supported) {
+            props.screencap_supported_methods.emplace_back(screencap_method_name(method));
+        }
+    }
+    registry.set_props(m_device_key, std::move(props));
+    device_lock.unlock();
+
+    start_prefetch();
+
+    return true;
+}
+
+bool asst::Controller::connect_replay(const std::string& session_dir,
+                                     const std::function<json::value()>& get_info_json)
+{
+    LogTraceFunction;
+
+    auto replayer = std::make_unique<SessionReplayer>(utils::path(session_dir));
+    if (!replayer->load()) {
+        json::value info = get_info_json() | json::object {
+            { "what", "ConnectFailed" },
+            { "why", "ReplaySessionNotFound" },
+        };
+        callback(AsstMsg::ConnectionInfo, info);
+        return false;
+    }
+
+    auto frame_size = replayer->frame_size();
+    m_width = frame_size.width;
+    m_height = frame_size.height;
+    m_uuid = "Replay";
+    m_session_replayer = std::move(replayer);
+    calc_scale_size();
+
+    json::value info = get_info_json() | json::object {
+        { "what", "Connected" },
+        { "why", "" },
+    };
+    callback(AsstMsg::ConnectionInfo, info);
+
+    // 回放的帧要按顺序一张张给出去，不开预取
+    make_instance_inited(true);
     return true;
 }
 
+void asst::Controller::calc_scale_size()
+{
+    constexpr double DefaultRatio = static_cast<double>(WindowWidthDefault) / static_cast<double>(WindowHeightDefault);
+    double cur_ratio = static_cast<double>(m_width) / static_cast<double>(m_height);
+
+    if (cur_ratio >= DefaultRatio // 说明是宽屏或默认16:9，按照高度计算缩放
+        || std::fabs(cur_ratio - DefaultRatio) < DoubleDiff) {
+        int scale_width = static_cast<int>(cur_ratio * WindowHeightDefault);
+        m_scale_size = std::make_pair(scale_width, WindowHeightDefault);
+        m_control_scale = static_cast<double>(m_height) / static_cast<double>(WindowHeightDefault);
+    }
+    else { // 否则可能是偏正方形的屏幕，按宽度计算
+        int scale_height = static_cast<int>(WindowWidthDefault / cur_ratio);
+        m_scale_size = std::make_pair(WindowWidthDefault, scale_height);
+        m_control_scale = static_cast<double>(m_width) / static_cast<double>(WindowWidthDefault);
+    }
+}
+
 void asst::Controller::make_instance_inited(bool inited)
 {
     Log.trace(__FUNCTION__, "|", inited, ", pre m_inited =", m_inited, ", pre m_instance_count =", m_instance_count);
@@ -1624,6 +2884,7 @@ void asst::Controller::kill_adb_daemon()
         if (!m_adb_release.empty()) {
             call_command(m_adb_release, 20000, false);
             m_adb_release.clear();
+            DeviceRegistry::get_instance().reset();
         }
     }
 }
@@ -1639,6 +2900,8 @@ void asst::Controller::release()
         if (!m_adb.release.empty()) {
             m_adb_release.clear();
             call_command(m_adb.release, 20000, false);
+            // adb server 已经 kill 掉了，之前缓存的连接状态都不作数
+            DeviceRegistry::get_instance().reset();
         }
     }
 }
@@ -1659,17 +2922,176 @@ void asst::Controller::set_swipe_with_pause(bool enable) noexcept
     m_swipe_with_pause_enabled = enable;
 }
 
+void asst::Controller::set_screencap_prefetch(bool enable)
+{
+    m_prefetch_enabled = enable;
+    if (enable) {
+        if (inited()) {
+            start_prefetch();
+        }
+    }
+    else {
+        stop_prefetch();
+    }
+}
+
+void asst::Controller::start_prefetch()
+{
+    std::unique_lock<std::mutex> thread_lock(m_prefetch_thread_mutex);
+    if (!m_prefetch_enabled || m_session_replayer || m_prefetch_thread.joinable()) {
+        return;
+    }
+    Log.info("start screencap prefetch");
+    m_prefetch_failed = false;
+    m_prefetch_running = true;
+    m_prefetch_thread = std::thread(&Controller::prefetch_proc, this);
+}
+
+void asst::Controller::stop_prefetch()
+{
+    std::unique_lock<std::mutex> thread_lock(m_prefetch_thread_mutex);
+    if (!m_prefetch_thread.joinable()) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_prefetch_mutex);
+        m_prefetch_running = false;
+    }
+    m_prefetch_cv.notify_all();
+    {
+        // 等在 m_frame_cv 上的 get_image 是拿着 m_image_mutex 检查条件的，过一下锁避免丢了通知
+        std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
+    }
+    m_frame_cv.notify_all();
+    m_prefetch_thread.join();
+    Log.info("screencap prefetch stopped");
+}
+
+void asst::Controller::prefetch_proc()
+{
+    LogTraceFunction;
+    using namespace std::chrono_literals;
+
+    // 一段时间没人要图就停下来，免得一直占着 adb 和 CPU
+    static constexpr auto IdleTimeout = 2s;
+    static constexpr auto RetryDelay = 100ms;
+
+    while (m_prefetch_running) {
+        {
+            std::unique_lock<std::mutex> lock(m_prefetch_mutex);
+            bool requested = m_prefetch_cv.wait_for(lock, IdleTimeout, [&]() {
+                return !m_prefetch_running || std::chrono::steady_clock::now() - m_last_request_time < IdleTimeout;
+            });
+            if (!m_prefetch_running) {
+                break;
+            }
+            if (!requested) {
+                continue;
+            }
+        }
+
+        bool ret = inited() && screencap();
+        if (ret == m_prefetch_failed) {
+            {
+                std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
+                m_prefetch_failed = !ret;
+            }
+            m_frame_cv.notify_all();
+        }
+        if (!ret) {
+            // 失败了让 get_image 自己走同步截图和重连的流程，这边歇一会再试
+            std::this_thread::sleep_for(RetryDelay);
+        }
+    }
+}
+
 const std::string& asst::Controller::get_uuid() const
 {
     return m_uuid;
 }
 
-cv::Mat asst::Controller::get_image(bool raw)
+cv::Mat asst::Controller::get_image(bool raw, bool after_input)
 {
+    report_latency_if_needed();
+
     if (m_scale_size.first == 0 || m_scale_size.second == 0) {
         Log.error("Unknown image size");
         return {};
     }
+    if (raw && !m_raw_image_requested) {
+        Log.info("raw image requested, decode screencap in full resolution from now on");
+        m_raw_image_requested = true;
+    }
+
+    // PNG 编码和写盘比较慢，不能拿着 m_image_mutex 做，不然预取线程一直换不进新帧。
+    // 传进来的是浅拷贝，换帧时发现还有人引用着就会另外分配，不会改到这张
+    auto record_frame = [&](const cv::Mat& image) {
+        if (m_session_recorder) {
+            m_session_recorder->add_frame(image);
+        }
+    };
+
+    if (m_session_replayer) {
+        // 回放完了就一直给最后一帧，报告一次结束，由调用方决定什么时候停
+        if (!screencap() && m_session_replayer->mark_finished()) {
+            json::value info = json::object {
+                { "uuid", m_uuid },
+                { "what", "ReplayFinished" },
+                { "why", "" },
+                { "details", m_session_replayer->stats() },
+            };
+            callback(AsstMsg::ConnectionInfo, info);
+        }
+        if (raw) {
+            std::shared_lock<std::shared_mutex> image_lock(m_image_mutex);
+            return m_cache_image.clone();
+        }
+        return get_resized_image_cache();
+    }
+
+    if (m_prefetch_running && inited()) {
+        using namespace std::chrono_literals;
+        static constexpr auto PrefetchWaitTimeout = 3s;
+
+        {
+            std::unique_lock<std::mutex> lock(m_prefetch_mutex);
+            m_last_request_time = std::chrono::steady_clock::now();
+        }
+        m_prefetch_cv.notify_one();
+
+        std::shared_lock<std::shared_mutex> image_lock(m_image_mutex);
+        // 要比上次拿走的帧新；要操作后的画面的话，还得是异步队列清空、最后一次操作结束之后才开始截的。
+        // 异步输入执行的时候预取线程照样在截，不符合的帧跳过就是了
+        bool fresh = m_frame_cv.wait_for(image_lock, PrefetchWaitTimeout, [&]() {
+            if (m_prefetch_failed || !m_prefetch_running) {
+                return true;
+            }
+            return m_frame_seq > m_consumed_frame_seq &&
+                   (!after_input || (m_pending_inputs == 0 && m_frame_time >= m_last_input_time.load()));
+        });
+        if (!fresh || m_prefetch_failed || !m_prefetch_running) {
+            Log.warn("prefetched frame is not available, screencap synchronously");
+        }
+        else if (raw && m_cache_image.size() != cv::Size(m_width, m_height)) {
+            // 刚开始要原图的时候，预取到的还是缩放过的帧，不能当原图给出去，下面同步截一张原分辨率的
+            Log.info("prefetched frame is scaled, screencap raw image synchronously");
+        }
+        else {
+            m_consumed_frame_seq = m_frame_seq;
+            cv::Mat frame = m_cache_image;
+            image_lock.unlock();
+            record_frame(frame);
+            if (raw) {
+                return frame.clone();
+            }
+            return get_resized_image_cache();
+        }
+    }
+
+    // 同步截图的话，异步队列里还有没执行完的输入时截到的不是操作后的画面
+    if (after_input) {
+        wait_for_input_queue();
+    }
 
     // 有些模拟器adb偶尔会莫名其妙截图失败，多试几次
     static constexpr int MaxTryCount = 20;
@@ -1697,11 +3119,22 @@ cv::Mat asst::Controller::get_image(bool raw)
         callback(AsstMsg::ConnectionInfo, info);
 
         const static cv::Size d_size(m_scale_size.first, m_scale_size.second);
+        std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
         m_cache_image = cv::Mat(d_size, CV_8UC3);
+        ++m_frame_seq;
 
         break;
     }
 
+    if (m_session_recorder) {
+        cv::Mat frame;
+        {
+            std::shared_lock<std::shared_mutex> image_lock(m_image_mutex);
+            frame = m_cache_image;
+        }
+        record_frame(frame);
+    }
+
     if (raw) {
         std::shared_lock<std::shared_mutex> image_lock(m_image_mutex);
         cv::Mat copy = m_cache_image.clone();
@@ -9,15 +9,29 @@
 #include <sys/socket.h>
 #endif
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <memory>
 #include <optional>
 #include <random>
 #include <shared_mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 
 #include "Common/AsstMsg.h"
 #include "Common/AsstTypes.h"
+#include "Controller/AdbClient.h"
+#include "Controller/DeviceRegistry.h"
+#include "Controller/FrameStream.h"
+#include "Controller/GzipInflateStream.h"
+#include "Controller/LatencyHistogram.h"
+#include "Controller/SessionRecord.h"
+#include "Controller/ShmFrameRing.h"
 #include "InstHelper.h"
 #include "Utils/NoWarningCVMat.h"
 #include "Utils/SingletonHolder.hpp"
@@ -38,10 +52,19 @@ namespace asst
         bool inited() const noexcept;
         void set_minitouch_enabled(bool enable, bool maa_touch = false) noexcept;
         void set_swipe_with_pause(bool enable) noexcept;
+        void set_screencap_prefetch(bool enable);
 
         const std::string& get_uuid() const;
-        cv::Mat get_image(bool raw = false);
+        // after_input 为 true 时保证拿到的帧是在之前所有输入（包括异步队列里的）执行完之后才开始截的；
+        // 不在乎的话传 false，不用等异步队列里的输入
+        cv::Mat get_image(bool raw = false, bool after_input = true);
         cv::Mat get_image_cache() const;
+        // 最近一次 get_image / get_image_cache 拿到的帧的序号
+        size_t get_image_seq() const noexcept;
+        // 最近拿到的帧和序号为 since_seq 的帧相比，roi（缩放后的坐标，为空则是全图）里有没有变化。
+        // 只保留最近几帧的缩略图，since_seq 太旧的话直接认为有变化。
+        // exact 为 false 时按块的平均灰度差判断，会忽略小的变化；为 true 时缩略图有一点不同就算变了
+        bool frame_changed(size_t since_seq, const Rect& roi = Rect(), bool exact = false) const;
         bool screencap(bool allow_reconnect = false);
 
         bool start_game(const std::string& client_type);
@@ -64,16 +87,41 @@ namespace asst
         bool press_esc();
         bool support_swipe_with_pause() const noexcept;
 
+        // 异步输入：放进队列由输入线程按顺序执行，调用方拿着 future 可以先去做别的事。
+        // 之后的同步输入会先等队列里的输入执行完，保证顺序；get_image 只在要操作后的画面时才等，
+        // 开了预取的话也不会停下截图，只是跳过输入执行完之前开始截的帧
+        std::future<bool> click_async(const Point& p);
+        std::future<bool> click_async(const Rect& rect);
+        std::future<bool> swipe_async(const Point& p1, const Point& p2, int duration = 0, bool extra_swipe = false,
+                                      double slope_in = 1, double slope_out = 1, bool with_pause = false);
+        std::future<bool> press_esc_async();
+
         std::pair<int, int> get_scale_size() const noexcept;
+        // 缩放图缓存的命中 / 未命中次数，first 为命中
+        std::pair<size_t, size_t> get_resize_cache_stats() const noexcept;
+        // 各阶段的耗时分布，{ "Spawn": { "count", "mean", "p50", "p95", "p99", "max" }, ... }，单位毫秒
+        json::value get_latency_stats() const;
 
         Controller& operator=(const Controller&) = delete;
         Controller& operator=(Controller&&) = delete;
 
     private:
+        // 每收到一段 stdout 数据就回调一次，可以边收边处理
+        using PipeDataFunc = std::function<void(const char* data, size_t size)>;
+
+        // recv_buffer: 用来接收输出的缓冲区，传入复用的 string 可以避免大块数据反复分配内存
         std::optional<std::string> call_command(const std::string& cmd, int64_t timeout = 20000,
-                                                bool allow_reconnect = true, bool recv_by_socket = false);
+                                                bool allow_reconnect = true, bool recv_by_socket = false,
+                                                std::string recv_buffer = {},
+                                                const PipeDataFunc& pipe_data_func = nullptr);
+        // 命令执行完之后的处理：成功返回输出，失败的话按需重连并重新执行
+        std::optional<std::string> on_command_finished(const std::string& cmd, int64_t timeout, bool allow_reconnect,
+                                                       bool recv_by_socket, int exit_ret, std::string output);
         void release();
         void kill_adb_daemon();
+        // config 为 "Replay:<目录>" 时不连设备，回放录好的会话
+        bool connect_replay(const std::string& session_dir, const std::function<json::value()>& get_info_json);
+        void calc_scale_size();
         void make_instance_inited(bool inited);
 
         void close_socket() noexcept;
@@ -81,13 +129,32 @@ namespace asst
 
         using DecodeFunc = std::function<bool(const std::string&)>;
         bool screencap(const std::string& cmd, const DecodeFunc& decode_func, bool allow_reconnect = false,
-                       bool by_socket = false);
+                       bool by_socket = false, const PipeDataFunc& pipe_data_func = nullptr);
+        bool screencap_by_adb_protocol(const DecodeFunc& decode_func);
         void clear_lf_info();
         cv::Mat get_resized_image_cache() const;
+        void record_frame_thumbnail(size_t seq, const cv::Mat& image) const;
 
         Point rand_point_in_rect(const Rect& rect);
+        // 录制时记下输入；回放时只交给回放器核对，返回 true 表示不用真的执行
+        bool replay_or_record_input(json::value input);
 
         void random_delay() const;
+
+        enum class LatencyStage
+        {
+            Spawn,     // 拉起 adb 进程
+            Transfer,  // 等命令输出 / 截图数据传完
+            ConvertLf, // CRLF 转 LF
+            Decode,    // 解压、解码、转颜色
+            Resize,    // 缩放到 m_scale_size
+            Click,     // 一次点击从开始到返回
+            Swipe,     // 一次滑动从开始到返回
+            Count,
+        };
+        LatencyHistogram& latency(LatencyStage stage) const { return m_latency[static_cast<size_t>(stage)]; }
+        // 每隔一段时间通过 ConnectionInfo 回调报告一次耗时分布
+        void report_latency_if_needed();
         void clear_info() noexcept;
         void callback(AsstMsg msg, const json::value& details);
 
@@ -95,6 +162,27 @@ namespace asst
         bool input_to_minitouch(const std::string& cmd);
         void release_minitouch(bool force = false);
 
+        // 常驻的 adb shell 会话，shell 类命令直接写进会话里执行，省掉每次拉起 adb 进程的开销
+        bool call_and_hup_shell_session();
+        std::optional<std::string> shell_command_of(const std::string& cmd) const;
+        std::optional<std::string> call_by_shell_session(const std::string& cmd, int64_t timeout, int& exit_ret);
+        std::optional<std::string> read_shell_session_until(const std::string& marker, int64_t timeout);
+        void release_shell_session();
+
+        // 设备上常驻的 emitter 持续推帧，截图时直接拿最新一帧
+        bool call_and_hup_frame_stream();
+        void release_frame_stream();
+
+        // 后台截图线程：持续截图放进 m_cache_image，get_image 直接拿最新的帧，识别和截图可以并行
+        void start_prefetch();
+        void stop_prefetch();
+        void prefetch_proc();
+
+        std::future<bool> post_input(std::function<bool()> func);
+        void wait_for_input_queue();
+        void stop_input_thread();
+        void input_proc();
+
         // 转换 data 中的 CRLF 为 LF：有些模拟器自带的 adb，exec-out 输出的 \n 会被替换成 \r\n，
         // 导致解码错误，所以这里转一下回来（点名批评 mumu 和雷电）
         static bool convert_lf(std::string& data);
@@ -141,6 +229,12 @@ namespace asst
 
             std::string start;
             std::string stop;
+            std::string shell_session;
+            std::string screencap_raw_by_adb_protocol;
+            std::string screencap_shared_memory;
+            std::string call_stream_emitter;
+            std::string forward_stream;
+            std::string remove_forward_stream;
 
             /* properties */
             enum class ScreencapEndOfLine
@@ -157,10 +251,55 @@ namespace asst
                 // Default,
                 RawByNc,
                 RawWithGzip,
-                Encode
+                Encode,
+                RawByAdbProtocol,
+                SharedMemory,
+                Stream
             } screencap_method = ScreencapMethod::UnknownYet;
         } m_adb;
 
+        // 每种截图方式的耗时和失败统计，用来定期重新挑最快的方式
+        struct ScreencapStats
+        {
+            bool supported = false; // 连接时测过能用
+            size_t samples = 0;
+            size_t failures = 0;
+            int consecutive_failures = 0;
+            double avg_cost = 0; // 毫秒，指数滑动平均
+            AdbProperty::ScreencapEndOfLine end_of_line = AdbProperty::ScreencapEndOfLine::UnknownYet;
+            size_t data_general_size = 0;
+        };
+        std::unordered_map<AdbProperty::ScreencapMethod, ScreencapStats> m_screencap_stats;
+        size_t m_screencap_count_since_probe = 0;
+        static constexpr auto AllScreencapMethods = std::to_array<AdbProperty::ScreencapMethod>({
+            AdbProperty::ScreencapMethod::RawByNc,
+            AdbProperty::ScreencapMethod::RawWithGzip,
+            AdbProperty::ScreencapMethod::Encode,
+            AdbProperty::ScreencapMethod::RawByAdbProtocol,
+#ifndef _WIN32
+            AdbProperty::ScreencapMethod::SharedMemory, // 共享内存的 agent 只有 POSIX 的实现
+#endif
+            AdbProperty::ScreencapMethod::Stream,
+        });
+        static const std::string& screencap_method_name(AdbProperty::ScreencapMethod method);
+        // 用同一台设备上次测出来的截图方式，不能用就返回 false，调用方再重新测
+        bool use_cached_screencap_method(const DeviceRegistry::DeviceProps& props);
+
+        // 不经过 adb 可执行文件，直接和 adb server 通信。同一台设备的多个实例共用一个
+        std::shared_ptr<AdbClient> m_adb_client = nullptr;
+        // 在 DeviceRegistry 里的 key
+        std::string m_device_key;
+#ifndef _WIN32
+        // 本机的截图 agent 通过共享内存直接给帧
+        std::unique_ptr<ShmFrameReader> m_shm_frame_reader = nullptr;
+#endif
+        std::unique_ptr<FrameStreamReceiver> m_frame_stream = nullptr;
+        unsigned short m_stream_port = 0; // adb forward 分到的本机端口
+
+        // config 为 "Record:<配置名>:<目录>" 时边跑边录；回放时不会有任何 adb 命令
+        std::unique_ptr<SessionRecorder> m_session_recorder = nullptr;
+        std::unique_ptr<SessionReplayer> m_session_replayer = nullptr;
+
         bool m_swipe_with_pause_enabled = false;
 
         bool m_minitouch_enabled = true; // 开关
@@ -178,6 +317,23 @@ namespace asst
         // TODO
 #endif
 
+        std::mutex m_shell_session_mutex;
+        std::atomic_bool m_shell_session_available = false;
+        size_t m_shell_session_seq = 0;
+        std::string m_shell_session_pending; // 会话里读到但还没被消费的数据
+#ifdef _WIN32
+        HANDLE m_shell_session_parent_write = INVALID_HANDLE_VALUE;
+        HANDLE m_shell_session_parent_read = INVALID_HANDLE_VALUE;
+        HANDLE m_shell_session_read_event = INVALID_HANDLE_VALUE;
+        ASST_AUTO_DEDUCED_ZERO_INIT_START
+        PROCESS_INFORMATION m_shell_session_process_info = { INVALID_HANDLE_VALUE, INVALID_HANDLE_VALUE, 0, 0 };
+        ASST_AUTO_DEDUCED_ZERO_INIT_END
+#else
+        ::pid_t m_shell_session_process = -1;
+        int m_write_to_shell_session_fd = -1;
+        int m_read_from_shell_session_fd = -1;
+#endif
+
         std::string m_uuid;
         inline static std::string m_adb_release; // 开了 adb daemon，但是没连上模拟器的时候，
                                                  // m_adb 并不会存下 release 的命令，但最后仍然需要一次释放。
@@ -195,6 +351,62 @@ namespace asst
         mutable std::shared_mutex m_image_mutex;
         cv::Mat m_cache_image;
 
+        // 截图用的复用缓冲区，每帧数据都有几 MB，反复 malloc / free 开销不小
+        std::mutex m_screencap_mutex;
+        std::string m_screencap_buffer;         // adb 输出的原始数据
+        std::string m_screencap_inflate_buffer; // gzip 解压后的数据
+        GzipInflateStream m_screencap_inflate_stream; // 行尾已知时 RawWithGzip 边收边解压
+        cv::Mat m_screencap_back_image;         // 解码的目标，解码完成后和 m_cache_image 交换
+        cv::Mat m_screencap_scaled_rgba;        // 原始 RGBA 数据直接缩放到 m_scale_size 的结果，再转成 BGR
+        // 有人要过原分辨率的图（get_image(true)），之后 RGBA 的截图都按原分辨率解码
+        std::atomic_bool m_raw_image_requested = false;
+
+        // 以下两个由 m_image_mutex 保护，每换进来一帧 m_frame_seq 加一
+        size_t m_frame_seq = 0;
+        std::chrono::steady_clock::time_point m_frame_time; // 这一帧开始截图的时间
+        std::condition_variable_any m_frame_cv;
+
+        // 当前帧缩放到 m_scale_size 的结果，同一帧反复 get_image_cache 时不用再 resize 一遍
+        mutable std::mutex m_resized_image_mutex;
+        mutable cv::Mat m_resized_image;
+        mutable size_t m_resized_image_seq = 0; // 对应的 m_frame_seq，0 表示无效
+        mutable std::atomic_size_t m_resize_cache_hits = 0;
+        mutable std::atomic_size_t m_resize_cache_misses = 0;
+
+        mutable std::array<LatencyHistogram, static_cast<size_t>(LatencyStage::Count)> m_latency;
+        std::chrono::steady_clock::time_point m_last_latency_report = std::chrono::steady_clock::now();
+
+        // 变化检测用的缩略图：缩放后的图再缩小 FrameThumbnailScale 倍的灰度图，按帧序号保存最近几帧
+        static constexpr int FrameThumbnailScale = 4;
+        static constexpr size_t FrameThumbnailCount = 8;
+        mutable std::mutex m_thumbnail_mutex;
+        mutable std::deque<std::pair<size_t, cv::Mat>> m_frame_thumbnails;
+        mutable std::atomic_size_t m_image_seq = 0;
+
+        bool m_prefetch_enabled = false; // 开关
+        std::atomic_bool m_prefetch_running = false;
+        std::atomic_bool m_prefetch_failed = false;
+        std::atomic_size_t m_consumed_frame_seq = 0; // get_image 上次拿走的帧
+        std::atomic<std::chrono::steady_clock::time_point> m_last_input_time;
+        std::chrono::steady_clock::time_point m_last_request_time; // 由 m_prefetch_mutex 保护
+        std::mutex m_prefetch_mutex;
+        std::condition_variable m_prefetch_cv;
+        std::mutex m_prefetch_thread_mutex;
+        std::thread m_prefetch_thread;
+
+        struct InputRequest
+        {
+            std::function<bool()> func;
+            std::promise<bool> promise;
+        };
+        std::mutex m_input_mutex;
+        std::condition_variable m_input_cv; // 队列有新输入、执行完一个输入、要退出时都会通知
+        std::deque<InputRequest> m_input_queue;
+        bool m_input_busy = false;
+        std::atomic_size_t m_pending_inputs = 0; // 还没执行完的异步输入，预取时不用拿 m_input_mutex 就能判断
+        bool m_input_exit = false;
+        std::thread m_input_thread;
+
     private:
         struct MinitouchProps
         {
@@ -208,6 +420,8 @@ namespace asst
             int orientation = 0;
         } m_minitouch_props;
 
+        // 命令先攒在缓冲区里，到 up（一个手势结束）时一次写给 minitouch，
+        // 滑动时几十上百条 move 不用每条都 write 一次。w 命令是 minitouch 那边执行的，一起发过去不影响时序
         class Minitoucher
         {
         public:
@@ -217,123 +431,109 @@ namespace asst
             static constexpr int DefaultClickDelay = 50;
             static constexpr int DefaultSwipeDelay = 2;
             static constexpr int ExtraDelay = 0;
+            // 缓冲区超过这个大小就在命令边界上先写一次，免得一次写太多把管道堵住
+            static constexpr size_t FlushThreshold = 16 * 1024;
 
             Minitoucher(InputFunc func, const MinitouchProps& props, bool auto_sleep = true)
                 : m_input_func(func), m_props(props), m_auto_sleep(auto_sleep)
-            {}
+            {
+                m_buffer.reserve(4096);
+            }
 
             ~Minitoucher()
             {
+                flush();
                 if (m_auto_sleep) {
                     sleep();
                 }
             }
 
-            bool reset() { return m_input_func(reset_cmd()); }
-            bool commit() { return m_input_func(commit_cmd()); }
+            bool reset()
+            {
+                m_buffer.append("r\n");
+                return flush();
+            }
+            bool commit()
+            {
+                append_commit();
+                return auto_flush();
+            }
             bool down(int x, int y, int wait_ms = DefaultClickDelay, bool with_commit = true, int contact = 0)
             {
-                return m_input_func(down_cmd(x, y, wait_ms, with_commit, contact));
+                auto [c_x, c_y] = scale(x, y);
+                append_format("d %d %d %d %d\n", contact, c_x, c_y, m_props.max_pressure);
+                append_tail(wait_ms, with_commit);
+                return auto_flush();
             }
             bool move(int x, int y, int wait_ms = DefaultSwipeDelay, bool with_commit = true, int contact = 0)
             {
-                return m_input_func(move_cmd(x, y, wait_ms, with_commit, contact));
+                auto [c_x, c_y] = scale(x, y);
+                append_format("m %d %d %d %d\n", contact, c_x, c_y, m_props.max_pressure);
+                append_tail(wait_ms, with_commit);
+                return auto_flush();
             }
+            // 手势到这里结束，连同之前攒下的命令一起写出去
             bool up(int wait_ms = DefaultClickDelay, bool with_commit = true, int contact = 0)
             {
-                return m_input_func(up_cmd(wait_ms, with_commit, contact));
+                append_format("u %d\n", contact);
+                append_tail(wait_ms, with_commit);
+                return flush();
             }
             bool key_down(int key_code, int wait_ms = DefaultClickDelay, bool with_commit = true)
             {
-                return m_input_func(key_down_cmd(key_code, wait_ms, with_commit));
+                append_format("k %d d\n", key_code);
+                append_tail(wait_ms, with_commit);
+                return auto_flush();
             }
             bool key_up(int key_code, int wait_ms = DefaultClickDelay, bool with_commit = true)
             {
-                return m_input_func(key_up_cmd(key_code, wait_ms, with_commit));
+                append_format("k %d u\n", key_code);
+                append_tail(wait_ms, with_commit);
+                return auto_flush();
             }
-            bool wait(int ms) { return m_input_func(wait_cmd(ms)); }
-            void clear() noexcept { m_wait_ms_count = 0; }
-
-        private:
-            [[nodiscard]] std::string reset_cmd() const noexcept { return "r\n"; }
-            [[nodiscard]] std::string commit_cmd() const noexcept { return "c\n"; }
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable : 4996)
-#endif
-            [[nodiscard]] std::string down_cmd(int x, int y, int wait_ms = DefaultClickDelay, bool with_commit = true,
-                                               int contact = 0)
+            bool wait(int ms)
             {
-                // mac 编不过
-                // std::string str = std::format("d {} {} {} {}\n", contact, x, y, pressure);
-
-                char buff[64] = { 0 };
-                auto [c_x, c_y] = scale(x, y);
-                sprintf(buff, "d %d %d %d %d\n", contact, c_x, c_y, m_props.max_pressure);
-                std::string str = buff;
-
-                if (with_commit) str += commit_cmd();
-                if (wait_ms) str += wait_cmd(wait_ms);
-                return str;
+                append_wait(ms);
+                return auto_flush();
             }
-
-            [[nodiscard]] std::string move_cmd(int x, int y, int wait_ms = DefaultSwipeDelay, bool with_commit = true,
-                                               int contact = 0)
+            bool flush()
             {
-                char buff[64] = { 0 };
-                auto [c_x, c_y] = scale(x, y);
-                sprintf(buff, "m %d %d %d %d\n", contact, c_x, c_y, m_props.max_pressure);
-                std::string str = buff;
-
-                if (with_commit) str += commit_cmd();
-                if (wait_ms) str += wait_cmd(wait_ms);
-                return str;
+                if (m_buffer.empty()) {
+                    return true;
+                }
+                bool ret = m_input_func(m_buffer);
+                m_buffer.clear();
+                return ret;
             }
-
-            [[nodiscard]] std::string up_cmd(int wait_ms = DefaultClickDelay, bool with_commit = true, int contact = 0)
+            void clear() noexcept
             {
-                char buff[16] = { 0 };
-                sprintf(buff, "u %d\n", contact);
-                std::string str = buff;
-
-                if (with_commit) str += commit_cmd();
-                if (wait_ms) str += wait_cmd(wait_ms);
-                return str;
+                m_wait_ms_count = 0;
+                m_buffer.clear();
             }
 
-            [[nodiscard]] std::string key_down_cmd(int key_code, int wait_ms = DefaultClickDelay,
-                                                   bool with_commit = true)
+        private:
+            template <typename... Args>
+            void append_format(const char* format, Args... args)
             {
                 char buff[64] = { 0 };
-                sprintf(buff, "k %d d\n", key_code);
-                std::string str = buff;
-
-                if (with_commit) str += commit_cmd();
-                if (wait_ms) str += wait_cmd(wait_ms);
-                return str;
+                int len = snprintf(buff, sizeof(buff), format, args...);
+                if (len > 0) {
+                    m_buffer.append(buff, (std::min)(static_cast<size_t>(len), sizeof(buff) - 1));
+                }
             }
-
-            [[nodiscard]] std::string key_up_cmd(int key_code, int wait_ms = DefaultClickDelay, bool with_commit = true)
+            void append_commit() { m_buffer.append("c\n"); }
+            void append_wait(int ms)
             {
-                char buff[64] = { 0 };
-                sprintf(buff, "k %d u\n", key_code);
-                std::string str = buff;
-
-                if (with_commit) str += commit_cmd();
-                if (wait_ms) str += wait_cmd(wait_ms);
-                return str;
+                m_wait_ms_count += ms;
+                append_format("w %d\n", ms);
             }
-
-            [[nodiscard]] std::string wait_cmd(int ms)
+            void append_tail(int wait_ms, bool with_commit)
             {
-                m_wait_ms_count += ms;
-                char buff[16] = { 0 };
-                sprintf(buff, "w %d\n", ms);
-                return buff;
+                if (with_commit) append_commit();
+                if (wait_ms) append_wait(wait_ms);
             }
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
+            bool auto_flush() { return m_buffer.size() < FlushThreshold || flush(); }
+
             void sleep()
             {
                 using namespace std::chrono_literals;
@@ -373,9 +573,24 @@ namespace asst
             const MinitouchProps& m_props;
             int m_wait_ms_count = ExtraDelay;
             bool m_auto_sleep = false;
+            std::string m_buffer;
         };
 
     private:
+        // 同步输入开始前先等异步队列里的输入执行完，保证顺序；
+        // 析构时记录输入结束的时间，预取的帧要在这之后开始截的才算是操作后的画面
+        class InputGuard
+        {
+        public:
+            explicit InputGuard(Controller* ctrler) : m_ctrler(ctrler) { m_ctrler->wait_for_input_queue(); }
+            InputGuard(const InputGuard&) = delete;
+            ~InputGuard() { m_ctrler->m_last_input_time = std::chrono::steady_clock::now(); }
+            InputGuard& operator=(const InputGuard&) = delete;
+
+        private:
+            Controller* m_ctrler = nullptr;
+        };
+
 #ifdef _WIN32
         // for Windows socket
         class WsaHelper : public SingletonHolder<WsaHelper>
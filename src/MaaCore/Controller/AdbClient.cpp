@@ -0,0 +1,407 @@
+#include "AdbClient.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+
+#include "Utils/Logger.hpp"
+#include "Utils/Platform.hpp"
+
+asst::AdbClient::AdbClient(std::string serial, const std::string& server_address) : m_serial(std::move(serial))
+{
+    if (server_address.empty()) {
+        return;
+    }
+    if (size_t pos = server_address.rfind(':'); pos != std::string::npos) {
+        m_host = server_address.substr(0, pos);
+        m_port = static_cast<unsigned short>(std::strtoul(server_address.c_str() + pos + 1, nullptr, 10));
+    }
+    else {
+        m_host = server_address;
+        if (const char* env_port = std::getenv("ANDROID_ADB_SERVER_PORT"); env_port && *env_port) {
+            m_port = static_cast<unsigned short>(std::strtoul(env_port, nullptr, 10));
+        }
+    }
+    if (m_host == "localhost") {
+        m_host = "127.0.0.1";
+    }
+}
+
+bool asst::AdbClient::probe(int64_t timeout)
+{
+    LogTraceFunction;
+
+    socket_t sock = connect_server(timeout);
+    if (sock == InvalidSocket) {
+        return false;
+    }
+
+    bool ret = false;
+    std::string reason;
+    if (send_request(sock, "host-serial:" + m_serial + ":get-state") && read_status(sock, &reason)) {
+        // OKAY 之后是 4 位十六进制长度 + 状态字符串
+        std::array<char, 4> len_hex {};
+        if (recv_all(sock, len_hex.data(), len_hex.size())) {
+            size_t len = std::strtoul(std::string(len_hex.data(), len_hex.size()).c_str(), nullptr, 16);
+            std::string state(len, '\0');
+            if (recv_all(sock, state.data(), len)) {
+                Log.info("adb server state of", m_serial, ":", state);
+                ret = state == "device";
+            }
+        }
+    }
+    else {
+        Log.info("adb server get-state failed:", reason);
+    }
+    close(sock);
+    return ret;
+}
+
+std::optional<std::string> asst::AdbClient::shell(const std::string& cmd, int& exit_ret, int64_t timeout)
+{
+    if (m_shell_v2_unsupported) {
+        return std::nullopt;
+    }
+
+    socket_t sock = open_transport(timeout);
+    if (sock == InvalidSocket) {
+        return std::nullopt;
+    }
+
+    std::string reason;
+    if (!send_request(sock, "shell,v2,raw:" + cmd) || !read_status(sock, &reason)) {
+        close(sock);
+        // 没回应、连接断了之类的可能只是一时的，下次接着试；server 明确拒绝了才去确认设备是不是不支持
+        if (!reason.starts_with("FAIL")) {
+            Log.info("adb shell v2 failed:", reason);
+            return std::nullopt;
+        }
+        if (auto feats = features(timeout); feats && ("," + *feats + ",").find(",shell_v2,") == std::string::npos) {
+            Log.info("device does not support adb shell v2:", reason);
+            m_shell_v2_unsupported = true;
+        }
+        else {
+            Log.info("adb shell v2 failed:", reason);
+        }
+        return std::nullopt;
+    }
+
+    // shell v2 的每个包是 1 字节 id + 4 字节小端长度 + 数据，id 1 / 2 / 3 分别是 stdout、stderr、退出码
+    constexpr char IdStdout = 1;
+    constexpr char IdStderr = 2;
+    constexpr char IdExit = 3;
+
+    std::optional<std::string> ret = std::string();
+    std::optional<int> exit_code;
+    while (!exit_code) {
+        std::array<char, 5> header {};
+        if (!recv_all(sock, header.data(), header.size())) {
+            break;
+        }
+        uint32_t len = 0;
+        for (int i = 0; i < 4; ++i) {
+            len |= static_cast<uint32_t>(static_cast<unsigned char>(header[1 + i])) << (8 * i);
+        }
+        std::string data(len, '\0');
+        if (!recv_all(sock, data.data(), len)) {
+            break;
+        }
+        if (header[0] == IdStdout || header[0] == IdStderr) {
+            ret->append(data);
+        }
+        else if (header[0] == IdExit && len > 0) {
+            exit_code = static_cast<unsigned char>(data[0]);
+        }
+    }
+    close(sock);
+
+    if (!exit_code) {
+        Log.error("adb shell `", cmd, "` exited without exit code");
+        return std::nullopt;
+    }
+    exit_ret = *exit_code;
+    return ret;
+}
+
+std::optional<std::string> asst::AdbClient::features(int64_t timeout) const
+{
+    socket_t sock = connect_server(timeout);
+    if (sock == InvalidSocket) {
+        return std::nullopt;
+    }
+
+    std::optional<std::string> ret;
+    if (send_request(sock, "host-serial:" + m_serial + ":features") && read_status(sock)) {
+        // 和 get-state 一样，OKAY 之后是 4 位十六进制长度 + 逗号分隔的特性列表
+        std::array<char, 4> len_hex {};
+        if (recv_all(sock, len_hex.data(), len_hex.size())) {
+            size_t len = std::strtoul(std::string(len_hex.data(), len_hex.size()).c_str(), nullptr, 16);
+            std::string feats(len, '\0');
+            if (recv_all(sock, feats.data(), len)) {
+                ret = std::move(feats);
+            }
+        }
+    }
+    close(sock);
+    return ret;
+}
+
+std::optional<std::string> asst::AdbClient::exec(const std::string& cmd, int64_t timeout, std::string recv_buffer)
+{
+    return call_service("exec:" + cmd, timeout, std::move(recv_buffer));
+}
+
+bool asst::AdbClient::push(const std::filesystem::path& local, const std::string& remote, int mode, int64_t timeout)
+{
+    LogTraceFunction;
+
+    std::ifstream ifs(local, std::ios::in | std::ios::binary);
+    if (!ifs.is_open()) {
+        Log.error("failed to open", local);
+        return false;
+    }
+
+    socket_t sock = open_transport(timeout);
+    if (sock == InvalidSocket) {
+        return false;
+    }
+
+    auto sync_request = [&](std::string_view id, uint32_t value, std::string_view payload = {}) -> bool {
+        std::string packet(id);
+        for (int i = 0; i < 4; ++i) {
+            packet.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+        packet.append(payload);
+        return send_all(sock, packet.data(), packet.size());
+    };
+
+    bool ret = false;
+    do {
+        std::string reason;
+        if (!send_request(sock, "sync:") || !read_status(sock, &reason)) {
+            Log.error("adb sync failed:", reason);
+            break;
+        }
+
+        // 0100000 即 S_IFREG，Windows 下没有这个宏
+        std::string path_and_mode = remote + "," + std::to_string(0100000 | mode);
+        if (!sync_request("SEND", static_cast<uint32_t>(path_and_mode.size()), path_and_mode)) {
+            break;
+        }
+
+        constexpr size_t MaxDataSize = 64 * 1024;
+        auto buffer = std::make_unique<char[]>(MaxDataSize);
+        bool data_sent = true;
+        while (ifs) {
+            ifs.read(buffer.get(), MaxDataSize);
+            auto len = static_cast<uint32_t>(ifs.gcount());
+            if (len == 0) {
+                break;
+            }
+            if (!sync_request("DATA", len, std::string_view(buffer.get(), len))) {
+                data_sent = false;
+                break;
+            }
+        }
+        if (!data_sent) {
+            break;
+        }
+
+        auto mtime = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+                .count());
+        if (!sync_request("DONE", mtime)) {
+            break;
+        }
+
+        std::array<char, 8> resp {};
+        if (!recv_all(sock, resp.data(), resp.size())) {
+            break;
+        }
+        if (std::string_view(resp.data(), 4) != "OKAY") {
+            uint32_t len = 0;
+            for (int i = 0; i < 4; ++i) {
+                len |= static_cast<uint32_t>(static_cast<unsigned char>(resp[4 + i])) << (8 * i);
+            }
+            std::string msg(len, '\0');
+            recv_all(sock, msg.data(), len);
+            Log.error("adb sync push failed:", msg);
+            break;
+        }
+        sync_request("QUIT", 0);
+        ret = true;
+    } while (false);
+
+    close(sock);
+    Log.info("push", local, "to", remote, "ret", ret);
+    return ret;
+}
+
+asst::AdbClient::socket_t asst::AdbClient::connect_server(int64_t timeout) const
+{
+    socket_t sock = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == InvalidSocket) {
+        Log.error("failed to create socket for adb server");
+        return InvalidSocket;
+    }
+
+#ifdef _WIN32
+    DWORD tv = static_cast<DWORD>(timeout);
+#else
+    timeval tv { .tv_sec = static_cast<time_t>(timeout / 1000),
+                 .tv_usec = static_cast<suseconds_t>(timeout % 1000 * 1000) };
+#endif
+    ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+    ::setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(m_port);
+    if (::inet_pton(AF_INET, m_host.c_str(), &addr.sin_addr) != 1) {
+        Log.error("invalid adb server address", m_host);
+        close(sock);
+        return InvalidSocket;
+    }
+    if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        Log.info("failed to connect adb server", m_host, m_port);
+        close(sock);
+        return InvalidSocket;
+    }
+    return sock;
+}
+
+asst::AdbClient::socket_t asst::AdbClient::open_transport(int64_t timeout) const
+{
+    socket_t sock = connect_server(timeout);
+    if (sock == InvalidSocket) {
+        return InvalidSocket;
+    }
+    std::string reason;
+    if (!send_request(sock, "host:transport:" + m_serial) || !read_status(sock, &reason)) {
+        Log.error("adb transport to", m_serial, "failed:", reason);
+        close(sock);
+        return InvalidSocket;
+    }
+    return sock;
+}
+
+std::optional<std::string> asst::AdbClient::call_service(const std::string& service, int64_t timeout,
+                                                         std::string recv_buffer) const
+{
+    using namespace std::chrono;
+    auto start_time = steady_clock::now();
+
+    socket_t sock = open_transport(timeout);
+    if (sock == InvalidSocket) {
+        return std::nullopt;
+    }
+
+    std::optional<std::string> ret;
+    std::string reason;
+    if (send_request(sock, service) && read_status(sock, &reason)) {
+        ret = recv_until_eof(sock, std::move(recv_buffer));
+    }
+    else {
+        Log.error("adb service `", service, "` failed:", reason);
+    }
+    close(sock);
+
+    auto duration = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+    Log.info("Call adb service `", service, "`, cost", duration, "ms , size:", ret ? ret->size() : 0);
+    return ret;
+}
+
+bool asst::AdbClient::send_request(socket_t sock, const std::string& request)
+{
+    char len_hex[5] = { 0 };
+    snprintf(len_hex, sizeof(len_hex), "%04zx", request.size());
+    std::string packet = len_hex + request;
+    return send_all(sock, packet.data(), packet.size());
+}
+
+bool asst::AdbClient::read_status(socket_t sock, std::string* fail_reason)
+{
+    std::array<char, 4> status {};
+    if (!recv_all(sock, status.data(), status.size())) {
+        if (fail_reason) *fail_reason = "no response";
+        return false;
+    }
+    if (std::string_view(status.data(), status.size()) == "OKAY") {
+        return true;
+    }
+    if (fail_reason) {
+        *fail_reason = std::string(status.data(), status.size());
+        std::array<char, 4> len_hex {};
+        if (recv_all(sock, len_hex.data(), len_hex.size())) {
+            size_t len = std::strtoul(std::string(len_hex.data(), len_hex.size()).c_str(), nullptr, 16);
+            std::string msg(len, '\0');
+            if (recv_all(sock, msg.data(), len)) {
+                *fail_reason += ": " + msg;
+            }
+        }
+    }
+    return false;
+}
+
+bool asst::AdbClient::send_all(socket_t sock, const char* data, size_t len)
+{
+    while (len > 0) {
+        auto sent = ::send(sock, data, static_cast<int>(len), 0);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool asst::AdbClient::recv_all(socket_t sock, char* data, size_t len)
+{
+    while (len > 0) {
+        auto received = ::recv(sock, data, static_cast<int>(len), 0);
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        len -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+std::optional<std::string> asst::AdbClient::recv_until_eof(socket_t sock, std::string data)
+{
+    data.clear();
+    asst::platform::single_page_buffer<char> buffer;
+    while (true) {
+        auto received = ::recv(sock, buffer.get(), static_cast<int>(buffer.size()), 0);
+        if (received == 0) {
+            return data;
+        }
+        if (received < 0) {
+            Log.error("recv from adb server failed");
+            return std::nullopt;
+        }
+        data.append(buffer.get(), static_cast<size_t>(received));
+    }
+}
+
+void asst::AdbClient::close(socket_t sock) noexcept
+{
+#ifdef _WIN32
+    ::closesocket(sock);
+#else
+    ::close(sock);
+#endif
+}
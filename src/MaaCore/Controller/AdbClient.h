@@ -0,0 +1,79 @@
+#pragma once
+
+#ifdef _WIN32
+#include "Utils/Platform/SafeWindows.h"
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace asst
+{
+    // 直接和 host 上的 adb server 通过 TCP 对话（adb 的 smart socket 协议），不再经过 adb 可执行文件，
+    // 截图等数据直接从 socket 读进来，省掉 adb 进程和管道的拷贝。
+    // 协议参考 https://android.googlesource.com/platform/packages/modules/adb/+/refs/heads/main/SERVICES.TXT
+    // Windows 下依赖调用方已经 WSAStartup 过（Controller 构造时会做）
+    class AdbClient
+    {
+    public:
+#ifdef _WIN32
+        using socket_t = SOCKET;
+        static constexpr socket_t InvalidSocket = INVALID_SOCKET;
+#else
+        using socket_t = int;
+        static constexpr socket_t InvalidSocket = -1;
+#endif
+        static constexpr unsigned short DefaultServerPort = 5037;
+
+    public:
+        // server_address 形如 "127.0.0.1:5037"，没写端口的话和 adb 一样先看 ANDROID_ADB_SERVER_PORT，再用默认端口
+        AdbClient(std::string serial, const std::string& server_address);
+        AdbClient(const AdbClient&) = delete;
+        AdbClient(AdbClient&&) = delete;
+        ~AdbClient() = default;
+
+        // 检查 server 是否在线且设备处于 device 状态
+        bool probe(int64_t timeout = 3000);
+
+        // 对应 `adb shell <cmd>`，走 shell v2 协议，exit_ret 为命令的退出码，输出里 stdout 和 stderr 混在一起。
+        // 失败时返回 nullopt；server 拒绝了请求且设备的特性列表里没有 shell_v2（Android 7 以下）的话，之后也不再尝试
+        std::optional<std::string> shell(const std::string& cmd, int& exit_ret, int64_t timeout = 20000);
+        // 对应 `adb features`，逗号分隔的特性列表
+        std::optional<std::string> features(int64_t timeout = 3000) const;
+        // 对应 `adb exec-out <cmd>`，输出是原始二进制数据。recv_buffer 会被复用来接收数据
+        std::optional<std::string> exec(const std::string& cmd, int64_t timeout = 20000, std::string recv_buffer = {});
+        // 对应 `adb push`，走 sync 协议
+        bool push(const std::filesystem::path& local, const std::string& remote, int mode = 0644,
+                  int64_t timeout = 20000);
+
+        const std::string& serial() const noexcept { return m_serial; }
+
+        AdbClient& operator=(const AdbClient&) = delete;
+        AdbClient& operator=(AdbClient&&) = delete;
+
+    private:
+        socket_t connect_server(int64_t timeout) const;
+        // 建立连接并切换到 m_serial 对应设备的 transport
+        socket_t open_transport(int64_t timeout) const;
+        std::optional<std::string> call_service(const std::string& service, int64_t timeout,
+                                                std::string recv_buffer = {}) const;
+
+        static bool send_request(socket_t sock, const std::string& request);
+        static bool read_status(socket_t sock, std::string* fail_reason = nullptr);
+        static bool send_all(socket_t sock, const char* data, size_t len);
+        static bool recv_all(socket_t sock, char* data, size_t len);
+        static std::optional<std::string> recv_until_eof(socket_t sock, std::string data);
+        static void close(socket_t sock) noexcept;
+
+        std::string m_serial;
+        std::string m_host = "127.0.0.1";
+        unsigned short m_port = DefaultServerPort;
+        std::atomic_bool m_shell_v2_unsupported = false;
+    };
+} // namespace asst
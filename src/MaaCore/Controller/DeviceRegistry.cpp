@@ -0,0 +1,151 @@
+#include "DeviceRegistry.h"
+
+#include <algorithm>
+
+#include "Utils/Logger.hpp"
+
+std::string asst::DeviceRegistry::make_key(const std::string& adb_path, const std::string& serial,
+                                          const std::string& config)
+{
+    // 路径、序列号和配置名里都不会有换行
+    return adb_path + '\n' + serial + '\n' + config;
+}
+
+std::unique_lock<std::mutex> asst::DeviceRegistry::lock_device(const std::string& key)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto& device = m_devices[key];
+    lock.unlock();
+    return std::unique_lock<std::mutex>(device.connect_mutex);
+}
+
+std::unique_lock<std::mutex> asst::DeviceRegistry::lock_server_if_cold(const std::string& adb_path)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto& server = m_servers[adb_path];
+    if (server.alive) {
+        return {};
+    }
+    lock.unlock();
+    return std::unique_lock<std::mutex>(server.start_mutex);
+}
+
+std::optional<asst::DeviceRegistry::DeviceProps> asst::DeviceRegistry::get_props(const std::string& key) const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto iter = m_devices.find(key);
+    if (iter == m_devices.end() || !iter->second.props || clock::now() - iter->second.props_time > PropsTTL) {
+        return std::nullopt;
+    }
+    return iter->second.props;
+}
+
+void asst::DeviceRegistry::set_props(const std::string& key, DeviceProps props)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto& device = m_devices[key];
+    device.props = std::move(props);
+    device.props_time = clock::now();
+}
+
+void asst::DeviceRegistry::invalidate(const std::string& key)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto iter = m_devices.find(key);
+    if (iter == m_devices.end()) {
+        return;
+    }
+    iter->second.props = std::nullopt;
+    iter->second.connected_time = std::nullopt;
+}
+
+void asst::DeviceRegistry::reset()
+{
+    LogTraceFunction;
+
+    // 别的线程可能正拿着里面的锁，只清数据，不删元素
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto& [key, device] : m_devices) {
+        device.props = std::nullopt;
+        device.connected_time = std::nullopt;
+        device.reconnect_failures = 0;
+        device.next_reconnect_time = {};
+    }
+    for (auto& [adb_path, server] : m_servers) {
+        server.alive = false;
+    }
+    for (auto& [key, client] : m_clients) {
+        client.probe_time = std::nullopt;
+    }
+}
+
+bool asst::DeviceRegistry::recently_connected(const std::string& key) const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto iter = m_devices.find(key);
+    return iter != m_devices.end() && iter->second.connected_time &&
+           clock::now() - *iter->second.connected_time < ConnectTTL;
+}
+
+void asst::DeviceRegistry::mark_connected(const std::string& adb_path, const std::string& key)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_servers[adb_path].alive = true;
+    auto& device = m_devices[key];
+    device.connected_time = clock::now();
+    ++device.connect_generation;
+}
+
+uint64_t asst::DeviceRegistry::connect_generation(const std::string& key) const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto iter = m_devices.find(key);
+    return iter == m_devices.end() ? 0 : iter->second.connect_generation;
+}
+
+std::shared_ptr<asst::AdbClient> asst::DeviceRegistry::get_adb_client(const std::string& serial,
+                                                                       const std::string& server_address)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto& client = m_clients[server_address + '\n' + serial];
+    lock.unlock();
+
+    // 同时来的实例等第一个探测完直接用它的结果
+    std::unique_lock<std::mutex> probe_lock(client.probe_mutex);
+    if (!client.probe_time || clock::now() - *client.probe_time > ProbeTTL) {
+        if (!client.client) {
+            client.client = std::make_shared<AdbClient>(serial, server_address);
+        }
+        client.available = client.client->probe();
+        client.probe_time = clock::now();
+    }
+    return client.available ? client.client : nullptr;
+}
+
+asst::DeviceRegistry::clock::duration asst::DeviceRegistry::reconnect_delay(const std::string& key) const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto iter = m_devices.find(key);
+    if (iter == m_devices.end()) {
+        return MinReconnectDelay;
+    }
+    return (std::max)(iter->second.next_reconnect_time - clock::now(), clock::duration(MinReconnectDelay));
+}
+
+void asst::DeviceRegistry::on_reconnect_result(const std::string& key, bool success)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto& device = m_devices[key];
+    if (success) {
+        device.reconnect_failures = 0;
+        device.next_reconnect_time = {};
+        device.connected_time = clock::now();
+        ++device.connect_generation;
+        return;
+    }
+    // 2s、4s、8s ... 最多 30s
+    auto delay = MinReconnectDelay * (1LL << (std::min)(device.reconnect_failures, 4));
+    device.next_reconnect_time = clock::now() + (std::min)(clock::duration(delay), clock::duration(MaxReconnectDelay));
+    ++device.reconnect_failures;
+    device.connected_time = std::nullopt;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Controller/AdbClient.h"
+#include "Utils/SingletonHolder.hpp"
+
+namespace asst
+{
+    // 进程内所有 Controller 共用的设备表，按 adb 路径 + 设备序列号 + 连接配置区分设备。
+    // 缓存的 display id、触控程序、截图方式都和配置里的命令有关，不同配置连同一台设备的不能共用。
+    // 多开时几十个实例一起连接，每个都把 adb connect、uuid、分辨率、abi、截图方式挨个查一遍会很慢，
+    // 这里把查到的设备属性缓存一段时间，同一个设备的 adb server 探测和 AdbClient 也只留一份。
+    // 同一台设备的连接、重连通过 lock_device 串行，重连失败按指数退避，免得一起去挤 adb
+    class DeviceRegistry final : public SingletonHolder<DeviceRegistry>
+    {
+    public:
+        struct DeviceProps
+        {
+            std::string uuid;
+            std::string display_id;
+            int width = 0;
+            int height = 0;
+            std::string minitouch_abi; // 按 abilist 选出来的 minitouch，用 maatouch 时为空
+            int orientation = 0;
+            std::string pushed_touch_program; // 已经推到设备上的触控程序
+            std::string screencap_method;     // 测出来最快的截图方式
+            std::vector<std::string> screencap_supported_methods;
+        };
+
+        using clock = std::chrono::steady_clock;
+
+        // 设备属性缓存多久，过期后下一个连接的实例重新查一遍
+        static constexpr auto PropsTTL = std::chrono::minutes(5);
+        // 这么短时间内连上过的设备不再执行 adb connect
+        static constexpr auto ConnectTTL = std::chrono::seconds(30);
+        static constexpr auto ProbeTTL = std::chrono::seconds(30);
+        static constexpr auto MinReconnectDelay = std::chrono::seconds(2);
+        static constexpr auto MaxReconnectDelay = std::chrono::seconds(30);
+
+    public:
+        virtual ~DeviceRegistry() override = default;
+
+        static std::string make_key(const std::string& adb_path, const std::string& serial, const std::string& config);
+
+        // 同一台设备的连接、重连要拿着这把锁做，后来的实例就能直接用前面查到的结果
+        std::unique_lock<std::mutex> lock_device(const std::string& key);
+        // adb server 还没确认起来的时候，同一个 adb 的连接命令串行执行，避免几十个 adb 进程同时去拉起 daemon。
+        // 已经确认起来了的话返回空锁
+        std::unique_lock<std::mutex> lock_server_if_cold(const std::string& adb_path);
+
+        std::optional<DeviceProps> get_props(const std::string& key) const;
+        void set_props(const std::string& key, DeviceProps props);
+        // 断线重连失败之类的情况，缓存的东西不一定还对
+        void invalidate(const std::string& key);
+        // adb server 被 kill 掉了，所有设备都要重新连
+        void reset();
+
+        bool recently_connected(const std::string& key) const;
+        void mark_connected(const std::string& adb_path, const std::string& key);
+        // 每次有实例成功执行了 adb connect（连接或者重连）就加一。
+        // 断线时记下来，之后变了才说明是断线之后别的实例重连上的，可以直接用它的结果
+        uint64_t connect_generation(const std::string& key) const;
+
+        // 同一个 server 上的同一台设备共用一个 AdbClient，探测结果缓存 ProbeTTL，不可用时返回 nullptr
+        std::shared_ptr<AdbClient> get_adb_client(const std::string& serial, const std::string& server_address);
+
+        // 距离下次允许重连还要等多久，至少 MinReconnectDelay
+        clock::duration reconnect_delay(const std::string& key) const;
+        void on_reconnect_result(const std::string& key, bool success);
+
+    private:
+        struct Device
+        {
+            std::mutex connect_mutex;
+            std::optional<DeviceProps> props;
+            clock::time_point props_time;
+            std::optional<clock::time_point> connected_time;
+            int reconnect_failures = 0;
+            clock::time_point next_reconnect_time;
+            uint64_t connect_generation = 0;
+        };
+
+        struct Server
+        {
+            std::mutex start_mutex;
+            bool alive = false;
+        };
+
+        struct Client
+        {
+            std::mutex probe_mutex;
+            std::shared_ptr<AdbClient> client;
+            bool available = false;
+            std::optional<clock::time_point> probe_time;
+        };
+
+        // unordered_map 的元素地址不会因为插入变化，锁可以放在元素里，拿到引用后放掉 m_mutex 再去等
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, Device> m_devices;
+        std::unordered_map<std::string, Server> m_servers;
+        std::unordered_map<std::string, Client> m_clients;
+    };
+} // namespace asst
@@ -0,0 +1,388 @@
+#include "FrameStream.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "Utils/Logger.hpp"
+#include "Utils/NoWarningCV.h"
+#include "Utils/Platform.hpp"
+
+bool asst::frame_stream::lz4_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size)
+{
+    // 参考 https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_size;
+
+    // 长度是 15 的话后面还跟着若干个字节，一直加到不是 255 为止
+    auto read_length = [&](size_t& length) -> bool {
+        if (length != 15) {
+            return true;
+        }
+        uint8_t byte = 0;
+        do {
+            if (ip >= iend) {
+                return false;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+
+        size_t literal_length = token >> 4;
+        if (!read_length(literal_length) || literal_length > static_cast<size_t>(iend - ip) ||
+            literal_length > static_cast<size_t>(oend - op)) {
+            return false;
+        }
+        if (literal_length > 0) {
+            std::memcpy(op, ip, literal_length);
+        }
+        ip += literal_length;
+        op += literal_length;
+
+        // 最后一个序列只有字面量
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        const size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) {
+            return false;
+        }
+
+        size_t match_length = token & 0x0f;
+        if (!read_length(match_length)) {
+            return false;
+        }
+        match_length += 4;
+        if (match_length > static_cast<size_t>(oend - op)) {
+            return false;
+        }
+
+        // 匹配和输出可能重叠（比如一长串同色的像素），每次拷贝不重叠的那一段，可拷的长度每轮翻倍
+        const uint8_t* match = op - offset;
+        while (match_length > 0) {
+            size_t length = (std::min)(match_length, static_cast<size_t>(op - match));
+            std::memcpy(op, match, length);
+            op += length;
+            match_length -= length;
+        }
+    }
+    return op == oend;
+}
+
+asst::FrameStreamReceiver::FrameStreamReceiver(int width, int height) : m_width(width), m_height(height) {}
+
+asst::FrameStreamReceiver::~FrameStreamReceiver()
+{
+    stop();
+}
+
+bool asst::FrameStreamReceiver::start(const std::string& emitter_cmd, unsigned short port, int64_t timeout)
+{
+    LogTraceFunction;
+    stop();
+
+    if (!spawn_emitter(emitter_cmd)) {
+        return false;
+    }
+
+    m_sock = connect_stream(port, timeout);
+    if (m_sock == InvalidSocket) {
+        kill_emitter();
+        return false;
+    }
+
+    m_frame_count = 0;
+    m_running = true;
+    m_recv_thread = std::thread(&FrameStreamReceiver::recv_loop, this);
+    return true;
+}
+
+void asst::FrameStreamReceiver::stop() noexcept
+{
+    m_running = false;
+    if (m_sock != InvalidSocket) {
+        // 让阻塞在 recv 里的接收线程返回
+#ifdef _WIN32
+        ::shutdown(m_sock, SD_BOTH);
+#else
+        ::shutdown(m_sock, SHUT_RDWR);
+#endif
+    }
+    if (m_recv_thread.joinable()) {
+        m_recv_thread.join();
+    }
+    if (m_sock != InvalidSocket) {
+        close_socket(m_sock);
+        m_sock = InvalidSocket;
+    }
+    kill_emitter();
+    m_frame_cv.notify_all();
+}
+
+bool asst::FrameStreamReceiver::read(cv::Mat& dst, int64_t timeout)
+{
+    using namespace frame_stream;
+
+    std::unique_lock<std::mutex> lock(m_frame_mutex);
+    const uint64_t count = m_frame_count;
+    // 要的是调用之后才收到的帧，不然可能是上一次操作之前的画面
+    m_frame_cv.wait_for(lock, std::chrono::milliseconds(timeout),
+                        [&]() { return m_frame_count != count || !m_running; });
+    if (m_frame_count == count) {
+        Log.warn("wait for stream frame timeout, running:", m_running.load());
+        return false;
+    }
+
+    const int cv_type = m_format == PixelFormat::RGBA ? CV_8UC4 : CV_8UC3;
+    cv::Mat src(m_height, m_width, cv_type, m_latest_frame.data());
+    if (m_format == PixelFormat::RGBA) {
+        cv::cvtColor(src, dst, cv::COLOR_RGBA2BGR);
+    }
+    else {
+        src.copyTo(dst);
+    }
+    return true;
+}
+
+asst::FrameStreamReceiver::socket_t asst::FrameStreamReceiver::connect_stream(unsigned short port, int64_t timeout)
+{
+    using namespace frame_stream;
+    using namespace std::chrono;
+
+    const auto deadline = steady_clock::now() + milliseconds(timeout);
+    while (steady_clock::now() < deadline) {
+        if (emitter_exited()) {
+            Log.error("stream emitter exited");
+            return InvalidSocket;
+        }
+
+        socket_t sock = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == InvalidSocket) {
+            Log.error("failed to create socket for frame stream");
+            return InvalidSocket;
+        }
+        // 收流时也留着这个超时，emitter 卡住的话接收线程能退出来
+#ifdef _WIN32
+        DWORD tv = static_cast<DWORD>(timeout);
+#else
+        timeval tv { .tv_sec = static_cast<time_t>(timeout / 1000),
+                     .tv_usec = static_cast<suseconds_t>(timeout % 1000 * 1000) };
+#endif
+        ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+        StreamHeader header {};
+        if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 &&
+            recv_all(sock, &header, sizeof(header))) {
+            if (header.magic != Magic || header.version != ProtocolVersion ||
+                (header.format != PixelFormat::RGBA && header.format != PixelFormat::BGR)) {
+                Log.error("invalid frame stream header");
+                close_socket(sock);
+                return InvalidSocket;
+            }
+            if (header.width != static_cast<uint32_t>(m_width) || header.height != static_cast<uint32_t>(m_height)) {
+                Log.error("frame stream size mismatch", header.width, header.height, "expected", m_width, m_height);
+                close_socket(sock);
+                return InvalidSocket;
+            }
+            m_format = header.format;
+            Log.info("frame stream connected, port", port, "format", static_cast<uint32_t>(header.format));
+            return sock;
+        }
+        close_socket(sock);
+        std::this_thread::sleep_for(100ms);
+    }
+    Log.error("connect frame stream timeout, port", port);
+    return InvalidSocket;
+}
+
+void asst::FrameStreamReceiver::recv_loop()
+{
+    using namespace frame_stream;
+
+    const size_t frame_size = static_cast<size_t>(m_width) * m_height * bytes_per_pixel(m_format);
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> back_frame(frame_size);
+
+    while (m_running) {
+        FrameHeader header {};
+        if (!recv_all(m_sock, &header, sizeof(header))) {
+            break;
+        }
+        if (header.raw_size != frame_size) {
+            Log.error("invalid stream frame size", header.raw_size, "expected", frame_size);
+            break;
+        }
+
+        if (header.codec == Codec::Raw) {
+            if (header.payload_size != frame_size || !recv_all(m_sock, back_frame.data(), frame_size)) {
+                break;
+            }
+        }
+        else if (header.codec == Codec::LZ4) {
+            payload.resize(header.payload_size);
+            if (!recv_all(m_sock, payload.data(), payload.size())) {
+                break;
+            }
+            if (!lz4_decompress(payload.data(), payload.size(), back_frame.data(), back_frame.size())) {
+                Log.error("failed to decompress stream frame", header.seq);
+                break;
+            }
+        }
+        else {
+            Log.error("unknown stream codec", static_cast<uint32_t>(header.codec));
+            break;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(m_frame_mutex);
+            m_latest_frame.swap(back_frame);
+            ++m_frame_count;
+        }
+        m_frame_cv.notify_all();
+    }
+
+    if (m_running) {
+        Log.warn("frame stream disconnected");
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_frame_mutex);
+        m_running = false;
+    }
+    m_frame_cv.notify_all();
+}
+
+bool asst::FrameStreamReceiver::recv_all(socket_t sock, void* data, size_t len)
+{
+    auto* ptr = static_cast<char*>(data);
+    while (len > 0) {
+        auto received = ::recv(sock, ptr, static_cast<int>((std::min)(len, size_t(1) << 30)), 0);
+        if (received <= 0) {
+            return false;
+        }
+        ptr += received;
+        len -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+void asst::FrameStreamReceiver::close_socket(socket_t sock) noexcept
+{
+#ifdef _WIN32
+    ::closesocket(sock);
+#else
+    ::close(sock);
+#endif
+}
+
+#ifdef _WIN32
+
+bool asst::FrameStreamReceiver::spawn_emitter(const std::string& cmd)
+{
+    Log.info(cmd);
+
+    STARTUPINFOW si {};
+    si.cb = sizeof(STARTUPINFOW);
+    si.dwFlags = STARTF_USESHOWWINDOW;
+    si.wShowWindow = SW_HIDE;
+
+    auto cmd_osstr = utils::to_osstring(cmd);
+    if (!CreateProcessW(NULL, cmd_osstr.data(), nullptr, nullptr, FALSE, CREATE_NO_WINDOW, nullptr, nullptr, &si,
+                        &m_emitter_process_info)) {
+        Log.error("Failed to create process for stream emitter, err", GetLastError());
+        m_emitter_process_info = { INVALID_HANDLE_VALUE, INVALID_HANDLE_VALUE, 0, 0 };
+        return false;
+    }
+    return true;
+}
+
+bool asst::FrameStreamReceiver::emitter_exited() noexcept
+{
+    return m_emitter_process_info.hProcess == INVALID_HANDLE_VALUE ||
+           WaitForSingleObject(m_emitter_process_info.hProcess, 0) == WAIT_OBJECT_0;
+}
+
+void asst::FrameStreamReceiver::kill_emitter() noexcept
+{
+    if (m_emitter_process_info.hProcess != INVALID_HANDLE_VALUE) {
+        TerminateProcess(m_emitter_process_info.hProcess, 0);
+        CloseHandle(m_emitter_process_info.hProcess);
+        m_emitter_process_info.hProcess = INVALID_HANDLE_VALUE;
+    }
+    if (m_emitter_process_info.hThread != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_emitter_process_info.hThread);
+        m_emitter_process_info.hThread = INVALID_HANDLE_VALUE;
+    }
+}
+
+#else
+
+bool asst::FrameStreamReceiver::spawn_emitter(const std::string& cmd)
+{
+    Log.info(cmd);
+
+    // emitter 的输出用不上，扔掉就行
+    int null_fd = ::open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd < 0) {
+        return false;
+    }
+    m_emitter_process = posix::spawn_shell(cmd, null_fd, null_fd);
+    ::close(null_fd);
+    if (m_emitter_process < 0) {
+        Log.error("Failed to create process for stream emitter");
+        return false;
+    }
+    return true;
+}
+
+bool asst::FrameStreamReceiver::emitter_exited() noexcept
+{
+    if (m_emitter_process <= 0) {
+        return true;
+    }
+    if (::waitpid(m_emitter_process, nullptr, WNOHANG) == m_emitter_process) {
+        m_emitter_process = -1;
+        return true;
+    }
+    return false;
+}
+
+void asst::FrameStreamReceiver::kill_emitter() noexcept
+{
+    if (m_emitter_process > 0) {
+        ::kill(m_emitter_process, SIGTERM);
+        ::waitpid(m_emitter_process, nullptr, 0);
+        m_emitter_process = -1;
+    }
+}
+
+#endif
@@ -0,0 +1,130 @@
+#pragma once
+
+#ifdef _WIN32
+#include "Utils/Platform/SafeWindows.h"
+#else
+#include <sys/types.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Utils/NoWarningCVMat.h"
+
+namespace asst
+{
+    // 流式截图：设备上常驻一个 emitter 进程，按固定帧率把屏幕写到 socket 上，这边一直收着，只留最新的一帧。
+    // 截图时不用再在模拟器里起一个 screencap 进程，这是其他截图方式延迟的下限。
+    // 协议都是小端：
+    //   连上之后 emitter 先发一个 StreamHeader，之后每帧是 FrameHeader + payload。
+    //   payload 是 RGBA 或 BGR 的原始像素，codec 为 LZ4 时是 LZ4 block 格式压缩过的
+    namespace frame_stream
+    {
+        inline constexpr uint32_t Magic = 0x5341414d; // "MAAS"
+        inline constexpr uint32_t ProtocolVersion = 1;
+
+        enum class PixelFormat : uint32_t
+        {
+            RGBA = 0, // 和 screencap 的原始数据一样
+            BGR = 1,
+        };
+
+        enum class Codec : uint32_t
+        {
+            Raw = 0,
+            LZ4 = 1,
+        };
+
+        struct StreamHeader
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t width;
+            uint32_t height;
+            PixelFormat format;
+        };
+        static_assert(sizeof(StreamHeader) == 20);
+
+        struct FrameHeader
+        {
+            uint32_t seq;
+            Codec codec;
+            uint32_t payload_size;
+            uint32_t raw_size;
+        };
+        static_assert(sizeof(FrameHeader) == 16);
+
+        inline constexpr size_t bytes_per_pixel(PixelFormat format) noexcept
+        {
+            return format == PixelFormat::RGBA ? 4 : 3;
+        }
+
+        // 解压一个 LZ4 block，解出来的大小必须正好是 dst_size，数据不对返回 false，不会越界
+        bool lz4_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+    } // namespace frame_stream
+
+    class FrameStreamReceiver
+    {
+    public:
+#ifdef _WIN32
+        using socket_t = SOCKET;
+        static constexpr socket_t InvalidSocket = INVALID_SOCKET;
+#else
+        using socket_t = int;
+        static constexpr socket_t InvalidSocket = -1;
+#endif
+
+    public:
+        FrameStreamReceiver(int width, int height);
+        FrameStreamReceiver(const FrameStreamReceiver&) = delete;
+        FrameStreamReceiver(FrameStreamReceiver&&) = delete;
+        ~FrameStreamReceiver();
+
+        // 执行 emitter_cmd 起 emitter（一般是 adb shell），然后连 127.0.0.1:port 直到收到流头。
+        // emitter 起来要点时间，adb forward 在设备那边还没监听时也能连上然后马上断开，所以会一直重试到超时
+        bool start(const std::string& emitter_cmd, unsigned short port, int64_t timeout = 5000);
+        void stop() noexcept;
+        bool running() const noexcept { return m_running; }
+
+        // 等一帧调用之后才收到的新帧，转换成 BGR 写进 dst。流断了或者超时返回 false
+        bool read(cv::Mat& dst, int64_t timeout = 2000);
+
+        FrameStreamReceiver& operator=(const FrameStreamReceiver&) = delete;
+        FrameStreamReceiver& operator=(FrameStreamReceiver&&) = delete;
+
+    private:
+        bool spawn_emitter(const std::string& cmd);
+        bool emitter_exited() noexcept;
+        void kill_emitter() noexcept;
+        socket_t connect_stream(unsigned short port, int64_t timeout);
+        void recv_loop();
+
+        static bool recv_all(socket_t sock, void* data, size_t len);
+        static void close_socket(socket_t sock) noexcept;
+
+        const int m_width;
+        const int m_height;
+        frame_stream::PixelFormat m_format = frame_stream::PixelFormat::RGBA;
+
+        socket_t m_sock = InvalidSocket;
+        std::atomic_bool m_running = false;
+        std::thread m_recv_thread;
+
+        std::mutex m_frame_mutex;
+        std::condition_variable m_frame_cv;
+        std::vector<uint8_t> m_latest_frame; // 收到的最新一帧，还是 emitter 发来的像素格式
+        uint64_t m_frame_count = 0;
+
+#ifdef _WIN32
+        PROCESS_INFORMATION m_emitter_process_info = { INVALID_HANDLE_VALUE, INVALID_HANDLE_VALUE, 0, 0 };
+#else
+        ::pid_t m_emitter_process = -1;
+#endif
+    };
+} // namespace asst
@@ -0,0 +1,145 @@
+#include "GzipInflateStream.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4068)
+#endif
+#include <zlib/decompress.hpp>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include "Utils/Logger.hpp"
+
+asst::GzipInflateStream::GzipInflateStream() : m_stream(std::make_unique<gzip::z_stream_s>()) {}
+
+asst::GzipInflateStream::~GzipInflateStream()
+{
+    if (m_stream_inited) {
+        gzip::inflateEnd(m_stream.get());
+    }
+}
+
+bool asst::GzipInflateStream::begin(size_t expected_size, bool convert_crlf)
+{
+    // 15 + 32: 窗口 15 位，自动识别 gzip / zlib 头，和 gzip::Decompressor 一致
+    constexpr int WindowBits = 15 + 32;
+
+    if (!m_stream_inited) {
+        *m_stream = {};
+        // inflateInit2 是个宏，里面的 z_stream 没带命名空间，这里直接展开
+        if (gzip::inflateInit2_(m_stream.get(), WindowBits, ZLIB_VERSION, static_cast<int>(sizeof(gzip::z_stream))) !=
+            Z_OK) {
+            Log.error("inflate init failed");
+            m_state = State::Failed;
+            return false;
+        }
+        m_stream_inited = true;
+    }
+    // reset 会保留 zlib 内部的窗口内存，不用每帧重新分配
+    else if (gzip::inflateReset(m_stream.get()) != Z_OK) {
+        Log.error("inflate reset failed");
+        m_state = State::Failed;
+        return false;
+    }
+
+    if (m_output.size() < expected_size) {
+        m_output.resize(expected_size);
+    }
+    m_output_size = 0;
+    m_convert_crlf = convert_crlf;
+    m_pending_cr = false;
+    m_state = State::Inflating;
+    return true;
+}
+
+bool asst::GzipInflateStream::feed(const char* data, size_t size)
+{
+    if (m_state != State::Inflating) {
+        return m_state == State::Finished;
+    }
+    if (!m_convert_crlf) {
+        return inflate_chunk(data, size);
+    }
+
+    m_crlf_buffer.clear();
+    const char* end = data + size;
+    if (m_pending_cr && data != end) {
+        if (*data != '\n') {
+            m_crlf_buffer.push_back('\r');
+        }
+        m_pending_cr = false;
+    }
+    while (data != end) {
+        const char* cr = std::find(data, end, '\r');
+        m_crlf_buffer.append(data, cr);
+        if (cr == end) {
+            break;
+        }
+        if (cr + 1 == end) {
+            m_pending_cr = true;
+            break;
+        }
+        if (cr[1] != '\n') {
+            m_crlf_buffer.push_back('\r');
+        }
+        data = cr + 1;
+    }
+    return inflate_chunk(m_crlf_buffer.data(), m_crlf_buffer.size());
+}
+
+bool asst::GzipInflateStream::finish()
+{
+    if (m_state == State::Inflating && m_pending_cr) {
+        m_pending_cr = false;
+        constexpr char CR = '\r';
+        inflate_chunk(&CR, 1);
+    }
+    if (m_state == State::Inflating) {
+        Log.error("gzip stream is incomplete, inflated size:", m_output_size);
+        m_state = State::Failed;
+    }
+    return m_state == State::Finished;
+}
+
+bool asst::GzipInflateStream::inflate_chunk(const char* data, size_t size)
+{
+    // 和 gzip::Decompressor 的默认值一致，防止异常数据把内存吃光
+    constexpr size_t MaxOutputSize = 1000000000;
+    constexpr size_t MinGrowSize = 64 * 1024;
+
+    auto& stream = *m_stream;
+    stream.next_in = reinterpret_cast<z_const gzip::Bytef*>(data);
+    stream.avail_in = static_cast<gzip::uInt>(size);
+
+    while (stream.avail_in > 0) {
+        if (m_output_size == m_output.size()) {
+            size_t new_size = (std::max)(m_output.size() * 2, MinGrowSize);
+            if (new_size > MaxOutputSize) {
+                Log.error("inflated data is too large");
+                m_state = State::Failed;
+                return false;
+            }
+            m_output.resize(new_size);
+        }
+        stream.next_out = reinterpret_cast<gzip::Bytef*>(m_output.data() + m_output_size);
+        stream.avail_out = static_cast<gzip::uInt>(m_output.size() - m_output_size);
+
+        int ret = gzip::inflate(&stream, Z_NO_FLUSH);
+        m_output_size = m_output.size() - stream.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            // gzip 流后面如果还有数据（比如 shell 的提示信息），直接丢掉
+            m_state = State::Finished;
+            return true;
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            Log.error("inflate failed, ret", ret);
+            m_state = State::Failed;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace gzip
+{
+    struct z_stream_s;
+}
+
+namespace asst
+{
+    // 边收数据边解压 gzip，解压结果直接写进复用的输出缓冲区，解压和传输可以同时进行。
+    // 有些模拟器的 adb 会把 \n 转成 \r\n，convert_crlf 时先转回来再解压
+    class GzipInflateStream
+    {
+    public:
+        GzipInflateStream();
+        GzipInflateStream(const GzipInflateStream&) = delete;
+        GzipInflateStream(GzipInflateStream&&) = delete;
+        ~GzipInflateStream();
+
+        // 开始解压新的一段数据，expected_size 是预计解压后的大小，缓冲区不够的话会先扩容
+        bool begin(size_t expected_size, bool convert_crlf = false);
+        // 喂一段压缩数据，出错后再喂的数据都会被忽略
+        bool feed(const char* data, size_t size);
+        // 数据收完了，返回是否完整解压出了一个 gzip 流。可以重复调用
+        bool finish();
+
+        std::string_view data() const noexcept { return { m_output.data(), m_output_size }; }
+
+        GzipInflateStream& operator=(const GzipInflateStream&) = delete;
+        GzipInflateStream& operator=(GzipInflateStream&&) = delete;
+
+    private:
+        bool inflate_chunk(const char* data, size_t size);
+
+        enum class State
+        {
+            Idle,
+            Inflating,
+            Finished,
+            Failed,
+        } m_state = State::Idle;
+
+        std::unique_ptr<gzip::z_stream_s> m_stream;
+        bool m_stream_inited = false;
+
+        bool m_convert_crlf = false;
+        bool m_pending_cr = false; // 上一段数据以 \r 结尾，要看下一段的第一个字节才知道是不是 \r\n
+        std::string m_crlf_buffer;
+
+        std::string m_output; // 只扩不缩，避免每帧都重新分配、清零
+        size_t m_output_size = 0;
+    };
+} // namespace asst
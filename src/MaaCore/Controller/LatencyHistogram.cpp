@@ -0,0 +1,80 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+void asst::LatencyHistogram::record(std::chrono::steady_clock::duration cost) noexcept
+{
+    auto us = static_cast<uint64_t>((std::max)(
+        std::chrono::duration_cast<std::chrono::microseconds>(cost).count(), std::chrono::microseconds::rep(0)));
+
+    m_buckets[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(us, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (us > max && !m_max.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+json::value asst::LatencyHistogram::summary() const
+{
+    // 各个计数是分开读的，和正在进行的记录之间可能差一两个，统计用足够了
+    std::array<uint64_t, BucketCount> buckets {};
+    uint64_t count = 0;
+    for (size_t i = 0; i < BucketCount; ++i) {
+        buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        count += buckets[i];
+    }
+    const uint64_t max = m_max.load(std::memory_order_relaxed);
+    const uint64_t sum = m_sum.load(std::memory_order_relaxed);
+
+    auto to_ms = [](uint64_t us) { return static_cast<double>(us) / 1000.0; };
+    auto percentile = [&](double p) -> double {
+        if (count == 0) {
+            return 0;
+        }
+        auto target = static_cast<uint64_t>(std::ceil(static_cast<double>(count) * p));
+        uint64_t accumulated = 0;
+        for (size_t i = 0; i < BucketCount; ++i) {
+            accumulated += buckets[i];
+            if (accumulated >= (std::max<uint64_t>)(target, 1)) {
+                return to_ms((std::min)(bucket_upper_bound(i), max));
+            }
+        }
+        return to_ms(max);
+    };
+
+    return json::object {
+        { "count", count },
+        { "mean", count ? to_ms(sum) / static_cast<double>(count) : 0.0 },
+        { "p50", percentile(0.50) },
+        { "p95", percentile(0.95) },
+        { "p99", percentile(0.99) },
+        { "max", to_ms(max) },
+    };
+}
+
+size_t asst::LatencyHistogram::bucket_index(uint64_t us) noexcept
+{
+    // 小于 2 * SubBucketCount 的值一微秒一格，之后每翻一倍格子宽度也翻一倍
+    if (us < SubBucketCount) {
+        return static_cast<size_t>(us);
+    }
+    int shift = std::bit_width(us) - 1 - SubBucketBits;
+    if (shift > MaxValueBits - SubBucketBits) {
+        return BucketCount - 1;
+    }
+    auto sub = (us >> shift) - SubBucketCount;
+    return static_cast<size_t>(SubBucketCount + static_cast<uint64_t>(shift) * SubBucketCount + sub);
+}
+
+uint64_t asst::LatencyHistogram::bucket_upper_bound(size_t index) noexcept
+{
+    if (index < SubBucketCount) {
+        return index;
+    }
+    auto shift = (index - SubBucketCount) / SubBucketCount;
+    auto sub = (index - SubBucketCount) % SubBucketCount;
+    return ((SubBucketCount + sub + 1) << shift) - 1;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <meojson/json.hpp>
+
+namespace asst
+{
+    // HDR 风格的耗时直方图：按微秒记录，每个 2 的幂区间再等分成 16 格，分位数的相对误差在 1/16 以内。
+    // 记录只是几个 relaxed 原子操作，截图线程、输入线程可以同时记，不用加锁
+    class LatencyHistogram
+    {
+    public:
+        class Scope
+        {
+        public:
+            explicit Scope(LatencyHistogram& histogram)
+                : m_histogram(histogram), m_start(std::chrono::steady_clock::now())
+            {}
+            Scope(const Scope&) = delete;
+            ~Scope() { m_histogram.record(std::chrono::steady_clock::now() - m_start); }
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            LatencyHistogram& m_histogram;
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+    public:
+        void record(std::chrono::steady_clock::duration cost) noexcept;
+        // count / mean / p50 / p95 / p99 / max，单位毫秒
+        json::value summary() const;
+
+    private:
+        static constexpr int SubBucketBits = 4;
+        static constexpr uint64_t SubBucketCount = 1ULL << SubBucketBits;
+        static constexpr int MaxValueBits = 40; // 2^40 微秒，十几天，再大的都算进最后一格
+        static constexpr size_t BucketCount = SubBucketCount * (MaxValueBits - SubBucketBits + 2);
+
+        static size_t bucket_index(uint64_t us) noexcept;
+        static uint64_t bucket_upper_bound(size_t index) noexcept;
+
+        std::array<std::atomic<uint64_t>, BucketCount> m_buckets {};
+        std::atomic<uint64_t> m_sum = 0;
+        std::atomic<uint64_t> m_max = 0;
+    };
+} // namespace asst
@@ -0,0 +1,228 @@
+#include "SessionRecord.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "Utils/ImageIo.hpp"
+#include "Utils/Logger.hpp"
+#include "Utils/WorkingDir.hpp"
+
+namespace
+{
+    std::filesystem::path resolve_session_dir(const std::filesystem::path& dir)
+    {
+        return dir.is_relative() ? asst::UserDir.get() / dir : dir;
+    }
+}
+
+asst::SessionRecorder::SessionRecorder(const std::filesystem::path& dir) : m_dir(resolve_session_dir(dir)) {}
+
+bool asst::SessionRecorder::open()
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_dir, ec);
+    // 重新录制时直接覆盖，旧的图片会被同名的新图片覆盖掉
+    m_index_ofs = std::ofstream(m_dir / SessionIndexFilename, std::ios::out | std::ios::trunc);
+    if (!m_index_ofs.is_open()) {
+        Log.error("failed to open session index in", m_dir, ec.message());
+        return false;
+    }
+    Log.info("record session to", m_dir);
+    return true;
+}
+
+void asst::SessionRecorder::add_input(json::value input)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pending_inputs.emplace_back(std::move(input));
+}
+
+bool asst::SessionRecorder::add_frame(const cv::Mat& image)
+{
+    // 录制主要用来做离线回放，文件体积不太重要，压缩等级低一点，少拖慢正常运行
+    static const std::vector<int> PngParams = { cv::IMWRITE_PNG_COMPRESSION, 1 };
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    char filename[16] = { 0 };
+    snprintf(filename, sizeof(filename), "%06zu.png", ++m_frame_count);
+    if (!asst::imwrite(m_dir / filename, image, PngParams)) {
+        Log.error("failed to write session frame", filename);
+        return false;
+    }
+
+    json::value line = json::object {
+        { "image", std::string(filename) },
+        { "inputs", std::move(m_pending_inputs) },
+    };
+    m_pending_inputs = json::array();
+    // 每帧都 flush，中途崩溃了也能回放崩溃之前的部分
+    m_index_ofs << line.to_string() << std::endl;
+    return m_index_ofs.good();
+}
+
+asst::SessionReplayer::SessionReplayer(const std::filesystem::path& dir) : m_dir(resolve_session_dir(dir)) {}
+
+bool asst::SessionReplayer::load()
+{
+    LogTraceFunction;
+
+    std::ifstream ifs(m_dir / SessionIndexFilename);
+    if (!ifs.is_open()) {
+        Log.error("failed to open session index in", m_dir);
+        return false;
+    }
+
+    std::string line;
+    size_t line_num = 0;
+    while (std::getline(ifs, line)) {
+        ++line_num;
+        if (line.empty()) {
+            continue;
+        }
+        auto line_opt = json::parse(line);
+        if (!line_opt || !line_opt->is_object()) {
+            Log.error("invalid session index at line", line_num);
+            return false;
+        }
+        Frame frame;
+        frame.image = line_opt->get("image", std::string());
+        if (auto inputs_opt = line_opt->find<json::array>("inputs")) {
+            for (const auto& input : inputs_opt.value()) {
+                frame.input_types.emplace_back(input.get("type", std::string()));
+            }
+        }
+        if (frame.image.empty()) {
+            Log.error("invalid session index at line", line_num);
+            return false;
+        }
+        m_frames.emplace_back(std::move(frame));
+    }
+    if (m_frames.empty()) {
+        Log.error("session is empty:", m_dir);
+        return false;
+    }
+
+    m_first_image = load_image(0);
+    if (m_first_image.empty()) {
+        return false;
+    }
+    m_frame_size = m_first_image.size();
+    Log.info("session loaded, frames:", m_frames.size(), ", size:", m_frame_size.width, m_frame_size.height);
+    return true;
+}
+
+void asst::SessionReplayer::add_input(json::value input)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_input_count;
+    m_received_input_types.emplace_back(input.get("type", std::string()));
+}
+
+cv::Mat asst::SessionReplayer::next_frame()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_finished) {
+        return {};
+    }
+    if (m_served_count == 0) {
+        m_start_time = std::chrono::steady_clock::now();
+    }
+
+    if (m_next_index == m_frames.size()) {
+        m_finished = true;
+        m_finish_time = std::chrono::steady_clock::now();
+        Log.info("session replay finished", make_stats().to_string());
+        return {};
+    }
+
+    const Frame& next = m_frames[m_next_index];
+    // 第一帧之前的输入是连接前的，不用等
+    bool inputs_arrived = m_next_index == 0 || m_received_input_types.size() >= next.input_types.size();
+    if (!inputs_arrived && ++m_repeat_count <= MaxRepeatCount && !m_current_image.empty()) {
+        ++m_served_count;
+        return m_current_image;
+    }
+    if (!inputs_arrived) {
+        Log.warn("replay is stuck at frame", m_next_index, ", expected inputs:", next.input_types.size(),
+                 ", received:", m_received_input_types.size());
+    }
+    m_mismatch_count += check_inputs(next);
+
+    auto load_start = std::chrono::steady_clock::now();
+    cv::Mat image = m_next_index == 0 ? std::move(m_first_image) : load_image(m_next_index);
+    m_load_cost += std::chrono::steady_clock::now() - load_start;
+    if (image.empty()) {
+        m_finished = true;
+        m_finish_time = std::chrono::steady_clock::now();
+        return {};
+    }
+
+    ++m_next_index;
+    ++m_served_count;
+    m_repeat_count = 0;
+    m_received_input_types.clear();
+    m_current_image = image;
+    return image;
+}
+
+bool asst::SessionReplayer::mark_finished()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_finished || m_finish_reported) {
+        return false;
+    }
+    m_finish_reported = true;
+    return true;
+}
+
+json::value asst::SessionReplayer::stats() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return make_stats();
+}
+
+json::value asst::SessionReplayer::make_stats() const
+{
+    using namespace std::chrono;
+
+    auto end_time = m_finished ? m_finish_time : steady_clock::now();
+    auto cost = m_served_count ? duration_cast<milliseconds>(end_time - m_start_time).count() : 0;
+    return json::object {
+        { "frames", m_frames.size() },
+        { "replayed_frames", m_next_index },
+        { "screencaps", m_served_count },
+        { "inputs", m_input_count },
+        { "mismatches", m_mismatch_count },
+        { "cost", cost },
+        // 读图解码的时间不算在识别里，单独给出来方便扣掉
+        { "load_cost", duration_cast<milliseconds>(m_load_cost).count() },
+    };
+}
+
+cv::Mat asst::SessionReplayer::load_image(size_t index) const
+{
+    auto path = m_dir / asst::utils::path(m_frames[index].image);
+    std::error_code ec;
+    cv::Mat image = std::filesystem::is_regular_file(path, ec) ? asst::imread(path) : cv::Mat();
+    if (image.empty()) {
+        Log.error("failed to read session frame", m_frames[index].image);
+    }
+    return image;
+}
+
+size_t asst::SessionReplayer::check_inputs(const Frame& frame) const
+{
+    size_t mismatch = 0;
+    size_t count = (std::max)(frame.input_types.size(), m_received_input_types.size());
+    for (size_t i = 0; i < count; ++i) {
+        if (i >= frame.input_types.size() || i >= m_received_input_types.size() ||
+            frame.input_types[i] != m_received_input_types[i]) {
+            ++mismatch;
+        }
+    }
+    if (mismatch) {
+        Log.warn("replay inputs mismatch before frame", frame.image, ", recorded:", frame.input_types,
+                 ", received:", m_received_input_types);
+    }
+    return mismatch;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <meojson/json.hpp>
+
+#include "Utils/NoWarningCVMat.h"
+
+namespace asst
+{
+    // 录制 / 回放的会话目录结构：
+    //   session.jsonl  每行一帧，{ "image": "000001.png", "inputs": [ 这一帧之前的输入, ... ] }
+    //   000001.png ... 每次 get_image 拿到的原始截图
+    // 输入形如 { "type": "click", "x": 100, "y": 200 }，坐标是设备上的原始坐标
+    inline constexpr std::string_view SessionIndexFilename = "session.jsonl";
+
+    // 正常运行时把每次拿到的帧和帧之间的输入记下来
+    class SessionRecorder
+    {
+    public:
+        // dir 是相对路径的话放在用户目录下
+        explicit SessionRecorder(const std::filesystem::path& dir);
+        SessionRecorder(const SessionRecorder&) = delete;
+        SessionRecorder(SessionRecorder&&) = delete;
+        ~SessionRecorder() = default;
+
+        bool open();
+        void add_input(json::value input);
+        bool add_frame(const cv::Mat& image);
+
+        SessionRecorder& operator=(const SessionRecorder&) = delete;
+        SessionRecorder& operator=(SessionRecorder&&) = delete;
+
+    private:
+        std::filesystem::path m_dir;
+        std::mutex m_mutex;
+        std::ofstream m_index_ofs;
+        json::array m_pending_inputs;
+        size_t m_frame_count = 0;
+    };
+
+    // 不连设备，按录下来的会话回放截图，输入只做核对。
+    // 一帧之前录到了几个输入，就要等回放时也收到这么多输入，才会换到这一帧，
+    // 所以任务链走得和录制时一样的话，每次截图拿到的画面也和录制时一样
+    class SessionReplayer
+    {
+    public:
+        // 回放时的输入和录制时对不上，同一帧最多重复给这么多次，之后强制往下走，免得卡死
+        static constexpr size_t MaxRepeatCount = 10;
+
+    public:
+        explicit SessionReplayer(const std::filesystem::path& dir);
+        SessionReplayer(const SessionReplayer&) = delete;
+        SessionReplayer(SessionReplayer&&) = delete;
+        ~SessionReplayer() = default;
+
+        // 读取索引，并加载第一帧用来确定分辨率
+        bool load();
+        cv::Size frame_size() const noexcept { return m_frame_size; }
+
+        void add_input(json::value input);
+        // 下一次截图的画面，回放完了返回空
+        cv::Mat next_frame();
+        // 回放完之后第一次调用返回 true，用来只报告一次结束
+        bool mark_finished();
+        // 帧数、输入数、对不上的次数、耗时等，用来衡量吞吐量
+        json::value stats() const;
+
+        SessionReplayer& operator=(const SessionReplayer&) = delete;
+        SessionReplayer& operator=(SessionReplayer&&) = delete;
+
+    private:
+        struct Frame
+        {
+            std::string image;
+            std::vector<std::string> input_types;
+        };
+
+        json::value make_stats() const;
+        cv::Mat load_image(size_t index) const;
+        // 把收到的输入和这一帧录到的对一下，返回对不上的个数
+        size_t check_inputs(const Frame& frame) const;
+
+        std::filesystem::path m_dir;
+        std::vector<Frame> m_frames;
+        cv::Size m_frame_size;
+
+        mutable std::mutex m_mutex;
+        size_t m_next_index = 0;
+        cv::Mat m_current_image;
+        cv::Mat m_first_image; // load 时为了拿分辨率读过的第一帧，回放时直接用
+        std::vector<std::string> m_received_input_types; // 当前帧之后收到的输入
+        size_t m_repeat_count = 0;
+        bool m_finished = false;
+        bool m_finish_reported = false;
+
+        size_t m_served_count = 0;
+        size_t m_input_count = 0;
+        size_t m_mismatch_count = 0;
+        std::chrono::steady_clock::time_point m_start_time;
+        std::chrono::steady_clock::time_point m_finish_time;
+        std::chrono::steady_clock::duration m_load_cost {};
+    };
+} // namespace asst
@@ -0,0 +1,130 @@
+#include "ShmFrameRing.h"
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Utils/Logger.hpp"
+#include "Utils/NoWarningCV.h"
+
+asst::ShmFrameReader::ShmFrameReader(std::string name) : m_name(std::move(name)) {}
+
+asst::ShmFrameReader::~ShmFrameReader()
+{
+    close();
+}
+
+
+bool asst::ShmFrameReader::read(cv::Mat& dst, int width, int height, int64_t timeout)
+{
+    using namespace shm_frame;
+    // agent 正在写的 slot 刚好是我们要读的，最多重读几次
+    static constexpr int MaxRetryCount = 3;
+
+    if (!m_data && !open()) {
+        return false;
+    }
+
+    auto& header = *static_cast<RingHeader*>(m_data);
+    if (header.width != static_cast<uint32_t>(width) || header.height != static_cast<uint32_t>(height)) {
+        Log.error("shared memory frame size mismatch", header.width, header.height, "expected", width, height);
+        close();
+        return false;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    uint32_t published = header.published.load(std::memory_order_acquire);
+    header.requested.fetch_add(1, std::memory_order_release);
+    wake_all(header.requested);
+
+    // 要的是调用之后才开始截的帧，不然可能是上一次操作之前的画面
+    if (!wait_changed(header.published, published, deadline)) {
+        Log.warn("wait for shared memory frame timeout");
+        // agent 可能重启过，重新创建了共享内存，下次重新映射
+        close();
+        return false;
+    }
+
+    auto* base = static_cast<uint8_t*>(m_data);
+    auto* slots = reinterpret_cast<SlotHeader*>(base + sizeof(RingHeader));
+    const int cv_type = header.format == PixelFormat::RGBA ? CV_8UC4 : CV_8UC3;
+
+    for (int i = 0; i < MaxRetryCount; ++i) {
+        uint32_t frame = header.published.load(std::memory_order_acquire);
+        uint32_t index = frame % header.slot_count;
+        auto& slot = slots[index];
+
+        uint32_t seq_before = slot.seq.load(std::memory_order_acquire);
+        if (seq_before % 2 != 0 || slot.frame != frame) {
+            continue;
+        }
+
+        cv::Mat src(height, width, cv_type, base + slot_offset(header.slot_count, header.slot_size, index));
+        if (header.format == PixelFormat::RGBA) {
+            cv::cvtColor(src, dst, cv::COLOR_RGBA2BGR);
+        }
+        else {
+            src.copyTo(dst);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq_before) {
+            return true;
+        }
+    }
+    Log.warn("shared memory frame is overwritten while reading");
+    return false;
+}
+
+bool asst::ShmFrameReader::open()
+{
+    using namespace shm_frame;
+
+    int fd = ::shm_open(m_name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(RingHeader)) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    // requested 要写，所以得是可读写的映射
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        Log.error("mmap shared memory failed", m_name);
+        return false;
+    }
+
+    const auto& header = *static_cast<const RingHeader*>(data);
+    if (header.magic != Magic || header.version != LayoutVersion || header.slot_count == 0 ||
+        (header.format != PixelFormat::RGBA && header.format != PixelFormat::BGR) ||
+        header.slot_size < aligned_slot_size(header.width, header.height, header.format) ||
+        size < total_size(header.slot_count, header.slot_size)) {
+        Log.error("invalid shared memory frame ring", m_name);
+        ::munmap(data, size);
+        return false;
+    }
+
+    m_data = data;
+    m_size = size;
+    Log.info("shared memory frame ring opened", m_name, header.width, header.height, "slots:", header.slot_count);
+    return true;
+}
+
+void asst::ShmFrameReader::close() noexcept
+{
+    if (m_data) {
+        ::munmap(m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
+
+#endif // _WIN32
@@ -0,0 +1,141 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Utils/NoWarningCVMat.h"
+
+namespace asst
+{
+    // 和本机的截图 agent 之间通过 POSIX 共享内存传帧，不再经过 adb 管道或者 nc socket。
+    // 只有 POSIX 的实现，Windows 下没有这个截图方式。
+    // 共享内存里是一个环形缓冲区：
+    //   [RingHeader][SlotHeader * slot_count][slot 0 像素][slot 1 像素]...
+    // agent 每写完一帧把 published 加一并用 futex 唤醒；每个 slot 用 seqlock 保护，读的时候被覆盖了就重读。
+    // 要新帧时把 requested 加一并唤醒，按需截图的 agent 可以等在这上面，一直推流的 agent 可以不管
+    namespace shm_frame
+    {
+        inline constexpr uint32_t Magic = 0x4641414d; // "MAAF"
+        inline constexpr uint32_t LayoutVersion = 1;
+
+        enum class PixelFormat : uint32_t
+        {
+            RGBA = 0, // 和 screencap 的原始数据一样
+            BGR = 1,
+        };
+
+        inline constexpr size_t bytes_per_pixel(PixelFormat format) noexcept
+        {
+            return format == PixelFormat::RGBA ? 4 : 3;
+        }
+
+        static_assert(std::atomic<uint32_t>::is_always_lock_free, "atomics in shared memory must be lock free");
+
+        struct alignas(64) RingHeader
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t slot_count;
+            uint32_t width;
+            uint32_t height;
+            PixelFormat format;
+            uint64_t slot_size; // 每个 slot 像素数据的字节数，按 64 对齐
+            std::atomic<uint32_t> published; // 已发布的帧数，最新的一帧在 slot (published % slot_count)
+            std::atomic<uint32_t> requested;
+        };
+
+        struct alignas(64) SlotHeader
+        {
+            std::atomic<uint32_t> seq; // 奇数表示正在写
+            uint32_t frame;            // 这个 slot 里是第几帧，和 published 对应
+        };
+
+        inline constexpr size_t slot_offset(uint32_t slot_count, uint64_t slot_size, uint32_t index) noexcept
+        {
+            return sizeof(RingHeader) + sizeof(SlotHeader) * slot_count + slot_size * index;
+        }
+
+        inline constexpr size_t total_size(uint32_t slot_count, uint64_t slot_size) noexcept
+        {
+            return slot_offset(slot_count, slot_size, slot_count);
+        }
+
+        inline constexpr uint64_t aligned_slot_size(uint32_t width, uint32_t height, PixelFormat format) noexcept
+        {
+            constexpr uint64_t Alignment = 64;
+            uint64_t size = static_cast<uint64_t>(width) * height * bytes_per_pixel(format);
+            return (size + Alignment - 1) / Alignment * Alignment;
+        }
+
+        // 跨进程的 futex，不能用 FUTEX_PRIVATE_FLAG。没有 futex 的平台只能短睡轮询
+        inline void wake_all(std::atomic<uint32_t>& word) noexcept
+        {
+#ifdef __linux__
+            ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#else
+            (void)word;
+#endif
+        }
+
+        // 等 word 不再是 expected，超时返回 false
+        inline bool wait_changed(const std::atomic<uint32_t>& word, uint32_t expected,
+                                 std::chrono::steady_clock::time_point deadline) noexcept
+        {
+            using namespace std::chrono;
+            while (word.load(std::memory_order_acquire) == expected) {
+                auto now = steady_clock::now();
+                if (now >= deadline) {
+                    return false;
+                }
+#ifdef __linux__
+                auto remaining = duration_cast<nanoseconds>(deadline - now).count();
+                timespec ts { static_cast<time_t>(remaining / 1'000'000'000),
+                              static_cast<long>(remaining % 1'000'000'000) };
+                ::syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#else
+                std::this_thread::sleep_for(1ms);
+#endif
+            }
+            return true;
+        }
+    } // namespace shm_frame
+
+    // Controller 这边的读端
+    class ShmFrameReader
+    {
+    public:
+        explicit ShmFrameReader(std::string name);
+        ShmFrameReader(const ShmFrameReader&) = delete;
+        ShmFrameReader(ShmFrameReader&&) = delete;
+        ~ShmFrameReader();
+
+        // 请求并等一帧调用之后才发布的新帧，直接从共享内存转换成 BGR 写进 dst，没有中间缓冲区。
+        // 分辨率和 width / height 对不上、agent 没起来或者超时了都返回 false
+        bool read(cv::Mat& dst, int width, int height, int64_t timeout = 2000);
+
+        ShmFrameReader& operator=(const ShmFrameReader&) = delete;
+        ShmFrameReader& operator=(ShmFrameReader&&) = delete;
+
+    private:
+        bool open();
+        void close() noexcept;
+
+        std::string m_name;
+        void* m_data = nullptr;
+        size_t m_size = 0;
+    };
+} // namespace asst
+
+#endif // _WIN32
@@ -1,5 +1,7 @@
 #include "BattleHelper.h"
 
+#include <algorithm>
+#include <chrono>
 #include <future>
 #include <thread>
 
@@ -174,7 +176,7 @@ bool asst::BattleHelper::update_deployment(bool init, const cv::Mat& reusable)
             auto analyze = [&](OcrImageAnalyzer& name_analyzer) {
                 name_analyzer.set_image(name_image);
                 name_analyzer.set_task_info(oper_name_ocr_task_name());
-                name_analyzer.set_replace(Task.get<OcrTaskInfo>("CharsNameOcrReplace")->replace_map);
+                name_analyzer.set_replace(Task.get<OcrTaskInfo>("CharsNameOcrReplace")->replace_rules);
                 if (!name_analyzer.analyze()) {
                     return std::string();
                 }
@@ -317,7 +319,8 @@ bool asst::BattleHelper::deploy_oper(const std::string& name, const Point& loc,
     }
 
     if (deploy_with_pause) {
-        m_inst_helper.ctrler()->press_esc();
+        // 取消暂停的 esc 不用等它执行完，后面的记录和 post_delay 可以和它并行；下次截图或操作前会等它
+        m_inst_helper.ctrler()->press_esc_async();
     }
 
     m_battlefield_opers.emplace(name, loc);
@@ -405,12 +408,14 @@ bool asst::BattleHelper::wait_until_start(bool weak)
 {
     LogTraceFunction;
 
-    cv::Mat image = m_inst_helper.ctrler()->get_image();
+    auto ctrler = m_inst_helper.ctrler();
+    cv::Mat image = ctrler->get_image();
+    size_t analyzed_seq = ctrler->get_image_seq();
     while (!m_inst_helper.need_exit() && !check_in_battle(image, weak)) {
         do_strategic_action(image);
         std::this_thread::yield();
 
-        image = m_inst_helper.ctrler()->get_image();
+        wait_for_frame_changed(image, analyzed_seq);
     }
     return true;
 }
@@ -419,16 +424,44 @@ bool asst::BattleHelper::wait_until_end(bool weak)
 {
     LogTraceFunction;
 
-    cv::Mat image = m_inst_helper.ctrler()->get_image();
+    auto ctrler = m_inst_helper.ctrler();
+    cv::Mat image = ctrler->get_image();
+    size_t analyzed_seq = ctrler->get_image_seq();
     while (!m_inst_helper.need_exit() && check_in_battle(image, weak)) {
         do_strategic_action(image);
         std::this_thread::yield();
 
-        image = m_inst_helper.ctrler()->get_image();
+        wait_for_frame_changed(image, analyzed_seq);
     }
     return true;
 }
 
+void asst::BattleHelper::wait_for_frame_changed(cv::Mat& image, size_t& analyzed_seq)
+{
+    // 画面和上次识别的一样的话，识别结果也不会变，不用再跑一遍模板匹配。
+    // 费用、击杀数、技能好了的图标这些变化都很小，按块平均的判断会漏掉，所以缩略图有一点不同就算变了。
+    // 没变化时逐渐拉长截图间隔，免得暂停、断线弹窗这种静止画面一直空转；
+    // 总共等了 MaxTotalWait 还没变也返回，让调用方重新识别，没点上的技能之类的操作也能再来一次
+    static constexpr auto MinInterval = std::chrono::milliseconds(20);
+    static constexpr auto MaxInterval = std::chrono::milliseconds(80);
+    static constexpr auto MaxTotalWait = std::chrono::milliseconds(300);
+
+    auto ctrler = m_inst_helper.ctrler();
+    auto interval = MinInterval;
+    auto waited = std::chrono::milliseconds(0);
+    while (true) {
+        image = ctrler->get_image();
+        if (m_inst_helper.need_exit() || ctrler->frame_changed(analyzed_seq, Rect(), true) ||
+            waited >= MaxTotalWait) {
+            break;
+        }
+        std::this_thread::sleep_for(interval);
+        waited += interval;
+        interval = (std::min)(interval * 2, MaxInterval);
+    }
+    analyzed_seq = ctrler->get_image_seq();
+}
+
 bool asst::BattleHelper::do_strategic_action(const cv::Mat& reusable)
 {
     cv::Mat image = reusable.empty() ? m_inst_helper.ctrler()->get_image() : reusable;
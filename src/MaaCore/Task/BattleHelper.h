@@ -48,6 +48,8 @@ namespace asst
         bool check_in_battle(const cv::Mat& reusable = cv::Mat(), bool weak = false);
         virtual bool wait_until_start(bool weak = true);
         bool wait_until_end(bool weak = true);
+        // 截图直到画面和 analyzed_seq 那一帧相比有变化，或者等了一小会儿都没变化，结果放进 image，并更新 analyzed_seq
+        void wait_for_frame_changed(cv::Mat& image, size_t& analyzed_seq);
         bool use_all_ready_skill(const cv::Mat& reusable = cv::Mat());
         bool check_and_use_skill(const std::string& name, const cv::Mat& reusable = cv::Mat());
         bool check_and_use_skill(const Point& loc, const cv::Mat& reusable = cv::Mat());
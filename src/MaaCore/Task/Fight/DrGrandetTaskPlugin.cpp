@@ -51,7 +51,7 @@ int asst::DrGrandetTaskPlugin::analyze_time_left()
 
     OcrImageAnalyzer analyzer(ctrler()->get_image());
     analyzer.set_task_info("DrGrandetUseOriginiums");
-    analyzer.set_replace(Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_map);
+    analyzer.set_replace(Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_rules);
     // 这里是汉字和数字混合的，用不了单独的en模型
     analyzer.set_use_char_model(false);
 
@@ -242,7 +242,7 @@ bool asst::InfrastAbstractTask::select_custom_opers(std::vector<std::string>& pa
     oper_analyzer.sort_by_loc();
     partial_result.clear();
 
-    const auto& ocr_replace = Task.get<OcrTaskInfo>("CharsNameOcrReplace")->replace_map;
+    const auto& ocr_replace = Task.get<OcrTaskInfo>("CharsNameOcrReplace")->replace_rules;
     for (const auto& oper : oper_analyzer.get_result()) {
         OcrWithPreprocessImageAnalyzer name_analyzer;
         name_analyzer.set_replace(ocr_replace);
@@ -297,7 +297,7 @@ void asst::InfrastAbstractTask::order_opers_selection(const std::vector<std::str
         return;
     }
     oper_analyzer.sort_by_loc();
-    const auto& ocr_replace = Task.get<OcrTaskInfo>("CharsNameOcrReplace")->replace_map;
+    const auto& ocr_replace = Task.get<OcrTaskInfo>("CharsNameOcrReplace")->replace_rules;
 
     std::vector<TextRect> page_result;
     for (const auto& oper : oper_analyzer.get_result()) {
@@ -589,12 +589,12 @@ bool asst::AutoRecruitTask::recruit_begin()
 bool asst::AutoRecruitTask::check_timer(int minutes_expected)
 {
     const auto image = ctrler()->get_image();
-    const auto replace_map = Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_map;
+    const auto& replace_rules = Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_rules;
 
     {
         OcrImageAnalyzer hour_ocr(image);
         hour_ocr.set_task_info("RecruitTimerH");
-        hour_ocr.set_replace(replace_map);
+        hour_ocr.set_replace(replace_rules);
         if (!hour_ocr.analyze()) return false;
         std::string desired_hour_str = std::string("0") + std::to_string(minutes_expected / 60);
         if (hour_ocr.get_result().front().text != desired_hour_str) return false;
@@ -604,7 +604,7 @@ bool asst::AutoRecruitTask::check_timer(int minutes_expected)
     {
         OcrImageAnalyzer minute_ocr(image);
         minute_ocr.set_task_info("RecruitTimerM");
-        minute_ocr.set_replace(replace_map);
+        minute_ocr.set_replace(replace_rules);
         if (!minute_ocr.analyze()) return false;
         std::string desired_minute_str = std::to_string((minutes_expected % 60) / 10) + "0";
         if (minute_ocr.get_result().front().text != desired_minute_str) return false;
@@ -35,7 +35,7 @@ int asst::CreditShoppingTask::credit_ocr()
     cv::Mat credit_image = ctrler()->get_image();
     OcrImageAnalyzer credit_analyzer(credit_image);
     credit_analyzer.set_task_info("CreditShop-CreditOcr");
-    credit_analyzer.set_replace(Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_map);
+    credit_analyzer.set_replace(Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_rules);
 
     if (!credit_analyzer.analyze()) {
         Log.trace("ERROR:!credit_analyzer.analyze():");
@@ -6,7 +6,9 @@
 
 #include <meojson/json.hpp>
 
+#include "Assistant.h"
 #include "Config/GeneralConfig.h"
+#include "Config/Miscellaneous/TaskHitStats.h"
 #include "Config/TaskData.h"
 #include "Controller.h"
 #include "Status.h"
@@ -113,11 +115,36 @@ bool ProcessTask::_run()
         }
         else {
             const auto image = ctrler()->get_image();
-            ProcessTaskImageAnalyzer analyzer(image, m_cur_task_name_list, m_inst);
+            const size_t image_seq = ctrler()->get_image_seq();
+            // 失败了还会算一次重试，小的变化（数字跳动、小图标出现）也可能让识别结果不同，缩略图完全一样才跳过
+            if (m_failed_image_seq && m_failed_task_name_list == m_cur_task_name_list &&
+                !ctrler()->frame_changed(m_failed_image_seq, Rect(), true)) {
+                Log.info("frame is not changed since last failure, skip recognition");
+                return false;
+            }
+            // m_cur_task_ptr 这时候还是上一个执行的任务
+            const std::string pre_task = m_cur_task_ptr ? m_cur_task_ptr->name : std::string();
+            const bool adaptive_order = m_inst->adaptive_task_order();
+            std::vector<std::string> tasks_name = m_cur_task_name_list;
+            if (adaptive_order) {
+                tasks_name = TaskHitStats::get_instance().reorder(pre_task, m_cur_task_name_list);
+                if (tasks_name != m_cur_task_name_list) {
+                    Log.trace("reordered by hit stats", tasks_name);
+                }
+            }
+            ProcessTaskImageAnalyzer analyzer(image, std::move(tasks_name), m_inst);
+            analyzer.set_parallel(m_inst->parallel_recognition());
 
-            if (!analyzer.analyze()) {
+            const bool analyzed = analyzer.analyze();
+            if (adaptive_order) {
+                TaskHitStats::get_instance().record(pre_task, analyzed ? analyzer.get_result()->name : std::string());
+            }
+            if (!analyzed) {
+                m_failed_image_seq = image_seq;
+                m_failed_task_name_list = m_cur_task_name_list;
                 return false;
             }
+            m_failed_image_seq = 0;
             m_cur_task_ptr = analyzer.get_result();
             rect = analyzer.get_rect();
         }
@@ -59,5 +59,9 @@ namespace asst
         std::unordered_map<std::string, int> m_exec_times;
         static constexpr int TaskDelayUnsetted = -1;
         int m_task_delay = TaskDelayUnsetted;
+
+        // 上次识别失败时的帧和任务列表，画面没变的话重试时不用再识别一遍
+        size_t m_failed_image_seq = 0;
+        std::vector<std::string> m_failed_task_name_list;
     };
 }
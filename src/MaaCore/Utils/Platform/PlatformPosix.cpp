@@ -2,10 +2,19 @@
 #include "PlatformPosix.h"
 #include "Platform.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdlib>
 #include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+extern char** environ;
 
 static size_t get_page_size()
 {
@@ -24,9 +33,61 @@ void asst::platform::aligned_free(void* ptr)
     ::free(ptr);
 }
 
+pid_t asst::posix::spawn_shell(const std::string& cmdline, int stdin_fd, int stdout_fd)
+{
+    posix_spawn_file_actions_t actions;
+    if (::posix_spawn_file_actions_init(&actions) != 0) {
+        return -1;
+    }
+    ::posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+    ::posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
+    ::posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDERR_FILENO);
+
+    const char* argv[] = { "sh", "-c", cmdline.c_str(), nullptr };
+    pid_t pid = -1;
+    int ret = ::posix_spawnp(&pid, "sh", &actions, nullptr, const_cast<char* const*>(argv), environ);
+    ::posix_spawn_file_actions_destroy(&actions);
+    return ret == 0 ? pid : -1;
+}
+
+asst::posix::ChildExitWatcher::ChildExitWatcher([[maybe_unused]] pid_t pid)
+{
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    // 老内核没有这个系统调用，返回 -1 就退化为轮询
+    m_pidfd = static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#endif
+}
+
+asst::posix::ChildExitWatcher::~ChildExitWatcher()
+{
+    if (m_pidfd >= 0) {
+        ::close(m_pidfd);
+    }
+}
+
+void asst::posix::wait_readable_or_exit(int read_fd, const ChildExitWatcher& watcher, int timeout_ms)
+{
+    constexpr int FallbackPollInterval = 10;
+
+    pollfd fds[2] {};
+    nfds_t count = 0;
+    if (read_fd >= 0) {
+        fds[count++] = { .fd = read_fd, .events = POLLIN, .revents = 0 };
+    }
+    if (watcher.fd() >= 0) {
+        fds[count++] = { .fd = watcher.fd(), .events = POLLIN, .revents = 0 };
+    }
+    else {
+        timeout_ms = std::min(timeout_ms, FallbackPollInterval);
+    }
+    ::poll(fds, count, std::max(timeout_ms, 0));
+}
+
 std::string asst::platform::call_command(const std::string& cmdline, bool* exit_flag)
 {
     constexpr int PipeBuffSize = 4096;
+    // exit_flag 没有通知机制，隔一段时间看一眼
+    constexpr int ExitFlagCheckInterval = 500;
     std::string pipe_str;
     auto pipe_buffer = std::make_unique<char[]>(PipeBuffSize);
 
@@ -40,49 +101,45 @@ std::string asst::platform::call_command(const std::string& cmdline, bool* exit_
         return {};
     }
     ::fcntl(pipe_out[PIPE_READ], F_SETFL, O_NONBLOCK);
-    int exit_ret = 0;
-    int child = ::fork();
-    if (child == 0) {
-        // child process
-        ::dup2(pipe_in[PIPE_READ], STDIN_FILENO);
-        ::dup2(pipe_out[PIPE_WRITE], STDOUT_FILENO);
-        ::dup2(pipe_out[PIPE_WRITE], STDERR_FILENO);
-
-        // all these are for use by parent only
-        ::close(pipe_in[PIPE_READ]);
-        ::close(pipe_in[PIPE_WRITE]);
-        ::close(pipe_out[PIPE_READ]);
-        ::close(pipe_out[PIPE_WRITE]);
-
-        exit_ret = execlp("sh", "sh", "-c", cmdline.c_str(), nullptr);
-        ::exit(exit_ret);
-    }
-    else if (child > 0) {
-        // parent process
+    // 父进程用的两端不要漏给子进程
+    ::fcntl(pipe_in[PIPE_WRITE], F_SETFD, FD_CLOEXEC);
+    ::fcntl(pipe_out[PIPE_READ], F_SETFD, FD_CLOEXEC);
 
-        // close unused file descriptors, these are for child only
-        ::close(pipe_in[PIPE_READ]);
-        ::close(pipe_out[PIPE_WRITE]);
+    pid_t child = posix::spawn_shell(cmdline, pipe_in[PIPE_READ], pipe_out[PIPE_WRITE]);
 
-        do {
-            ssize_t read_num = ::read(pipe_out[PIPE_READ], pipe_buffer.get(), PipeBuffSize);
+    // close unused file descriptors, these are for child only
+    ::close(pipe_in[PIPE_READ]);
+    ::close(pipe_out[PIPE_WRITE]);
 
-            while (read_num > 0) {
+    if (child > 0) {
+        posix::ChildExitWatcher watcher(child);
+        bool pipe_eof = false;
+        auto read_available = [&]() {
+            ssize_t read_num = 0;
+            while ((read_num = ::read(pipe_out[PIPE_READ], pipe_buffer.get(), PipeBuffSize)) > 0) {
                 pipe_str.append(pipe_buffer.get(), pipe_buffer.get() + read_num);
-                read_num = ::read(pipe_out[PIPE_READ], pipe_buffer.get(), PipeBuffSize);
-            };
-        } while (::waitpid(child, &exit_ret, WNOHANG) == 0 && !(exit_flag && *exit_flag));
+            }
+            // 写端都关了之后 poll 会一直返回 POLLHUP，不能再拿它来等
+            pipe_eof |= read_num == 0;
+        };
 
-        ::close(pipe_in[PIPE_WRITE]);
-        ::close(pipe_out[PIPE_READ]);
-    }
-    else {
-        // failed to create child process
-        ::close(pipe_in[PIPE_READ]);
-        ::close(pipe_in[PIPE_WRITE]);
-        ::close(pipe_out[PIPE_READ]);
-        ::close(pipe_out[PIPE_WRITE]);
+        int exit_ret = 0;
+        while (true) {
+            read_available();
+            if (::waitpid(child, &exit_ret, WNOHANG) != 0) {
+                // 子进程退出前写的数据可能还留在管道里
+                read_available();
+                break;
+            }
+            if (exit_flag && *exit_flag) {
+                break;
+            }
+            posix::wait_readable_or_exit(pipe_eof ? -1 : pipe_out[PIPE_READ], watcher, ExitFlagCheckInterval);
+        }
     }
+
+    ::close(pipe_in[PIPE_WRITE]);
+    ::close(pipe_out[PIPE_READ]);
     return pipe_str;
 }
 
@@ -1,4 +1,37 @@
 #pragma once
 #if __has_include(<unistd.h>)
 
+#include <string>
+
+#include <sys/types.h>
+
+namespace asst::posix
+{
+    // 用 posix_spawn 执行 `sh -c cmdline`，子进程的 stdin 接到 stdin_fd，stdout 和 stderr 接到 stdout_fd。
+    // 不用 fork 复制我们这个带着 OpenCV / ONNX 的大进程，失败返回 -1
+    pid_t spawn_shell(const std::string& cmdline, int stdin_fd, int stdout_fd);
+
+    // 等子进程退出用的。Linux 下是 pidfd，可以和管道一起 poll；拿不到的话 fd() 为 -1，只能靠超时轮询
+    class ChildExitWatcher
+    {
+    public:
+        explicit ChildExitWatcher(pid_t pid);
+        ChildExitWatcher(const ChildExitWatcher&) = delete;
+        ChildExitWatcher(ChildExitWatcher&&) = delete;
+        ~ChildExitWatcher();
+
+        int fd() const noexcept { return m_pidfd; }
+
+        ChildExitWatcher& operator=(const ChildExitWatcher&) = delete;
+        ChildExitWatcher& operator=(ChildExitWatcher&&) = delete;
+
+    private:
+        int m_pidfd = -1;
+    };
+
+    // 等 read_fd 可读或者子进程退出，最多 timeout_ms 毫秒；read_fd 为 -1 时只等子进程。
+    // 没有 pidfd 的时候最多等一小段时间就返回，调用方需要自己 waitpid 检查子进程是否退出了
+    void wait_readable_or_exit(int read_fd, const ChildExitWatcher& watcher, int timeout_ms);
+}
+
 #endif
@@ -1,5 +1,7 @@
 #include "HashImageAnalyzer.h"
 
+#include <bit>
+
 #include "Utils/NoWarningCV.h"
 
 #include "Utils/Logger.hpp"
@@ -32,8 +34,8 @@ bool asst::HashImageAnalyzer::analyze()
         if (m_need_bound) {
             to_hash = bound_bin(to_hash);
         }
-        std::string hash_result = s_hash(to_hash);
-        // Log.debug(hash_result);
+        ImageHash hash_result = s_hash(to_hash);
+        // Log.debug(to_hex(hash_result));
 
         int min_dist = INT_MAX;
         std::string cur_min_dist_name;
@@ -62,9 +64,17 @@ void asst::HashImageAnalyzer::set_mask_range(std::pair<int, int> mask_range) noe
     m_mask_range = std::move(mask_range);
 }
 
-void asst::HashImageAnalyzer::set_hash_templates(std::unordered_map<std::string, std::string> hash_templates) noexcept
+void asst::HashImageAnalyzer::set_hash_templates(const std::unordered_map<std::string, std::string>& hash_templates)
 {
-    m_hash_templates = std::move(hash_templates);
+    m_hash_templates.clear();
+    for (const auto& [name, hex] : hash_templates) {
+        auto hash_opt = from_hex(hex);
+        if (!hash_opt) {
+            Log.warn("invalid hash template", name, hex);
+            continue;
+        }
+        m_hash_templates.emplace(name, *hash_opt);
+    }
 }
 
 void asst::HashImageAnalyzer::set_need_split(bool need_split) noexcept
@@ -82,12 +92,12 @@ const std::vector<std::string>& asst::HashImageAnalyzer::get_min_dist_name() con
     return m_min_dist_name;
 }
 
-const std::vector<std::string>& asst::HashImageAnalyzer::get_hash() const noexcept
+const std::vector<asst::ImageHash>& asst::HashImageAnalyzer::get_hash() const noexcept
 {
     return m_hash_result;
 }
 
-std::string asst::HashImageAnalyzer::s_hash(const cv::Mat& img)
+asst::ImageHash asst::HashImageAnalyzer::s_hash(const cv::Mat& img)
 {
     static constexpr int HashKernelSize = 16;
     cv::Mat resized;
@@ -97,19 +107,14 @@ std::string asst::HashImageAnalyzer::s_hash(const cv::Mat& img)
         cv::cvtColor(resized, temp, cv::COLOR_BGR2GRAY);
         resized = temp;
     }
-    std::stringstream hash_value;
-    uchar* pix = resized.data;
-    int tmp_dec = 0;
+    ImageHash hash_value {};
+    const uchar* pix = resized.data;
     for (int ro = 0; ro < 256; ro++) {
-        tmp_dec = tmp_dec << 1;
-        if (*pix > 127) tmp_dec++;
-        if (ro % 4 == 3) {
-            hash_value << std::hex << tmp_dec;
-            tmp_dec = 0;
+        if (pix[ro] > 127) {
+            hash_value[ro / 64] |= uint64_t(1) << (63 - ro % 64);
         }
-        pix++;
     }
-    return hash_value.str();
+    return hash_value;
 }
 
 std::vector<cv::Mat> asst::HashImageAnalyzer::split_bin(const cv::Mat& bin)
@@ -152,20 +157,56 @@ cv::Mat asst::HashImageAnalyzer::bound_bin(const cv::Mat& bin)
     return bin(cv::boundingRect(bin));
 }
 
-int asst::HashImageAnalyzer::hamming(std::string hash1, std::string hash2)
+int asst::HashImageAnalyzer::hamming(const ImageHash& hash1, const ImageHash& hash2) noexcept
 {
-    static constexpr int HammingFlags = 64;
-
-    hash1.insert(hash1.begin(), HammingFlags - hash1.size(), '0');
-    hash2.insert(hash2.begin(), HammingFlags - hash2.size(), '0');
     int dist = 0;
-    for (int i = 0; i < HammingFlags; i = i + 16) {
-        unsigned long long x =
-            strtoull(hash1.substr(i, 16).c_str(), nullptr, 16) ^ strtoull(hash2.substr(i, 16).c_str(), nullptr, 16);
-        while (x) {
-            ++dist;
-            x = x & (x - 1);
-        }
+    for (size_t i = 0; i < hash1.size(); ++i) {
+        dist += std::popcount(hash1[i] ^ hash2[i]);
     }
     return dist;
 }
+
+std::string asst::HashImageAnalyzer::to_hex(const ImageHash& hash)
+{
+    static constexpr std::string_view HexDigits = "0123456789abcdef";
+
+    std::string hex;
+    hex.reserve(hash.size() * 16);
+    for (uint64_t word : hash) {
+        for (int shift = 60; shift >= 0; shift -= 4) {
+            hex.push_back(HexDigits[(word >> shift) & 0xf]);
+        }
+    }
+    return hex;
+}
+
+std::optional<asst::ImageHash> asst::HashImageAnalyzer::from_hex(std::string_view hex)
+{
+    static constexpr size_t HexLength = std::tuple_size_v<ImageHash> * 16;
+
+    if (hex.size() > HexLength) {
+        return std::nullopt;
+    }
+    ImageHash hash {};
+    // 和以前按字符串比较时一样，短的前面补 0
+    const size_t offset = HexLength - hex.size();
+    for (size_t i = 0; i < hex.size(); ++i) {
+        const char ch = hex[i];
+        uint64_t digit = 0;
+        if (ch >= '0' && ch <= '9') {
+            digit = ch - '0';
+        }
+        else if (ch >= 'a' && ch <= 'f') {
+            digit = ch - 'a' + 10;
+        }
+        else if (ch >= 'A' && ch <= 'F') {
+            digit = ch - 'A' + 10;
+        }
+        else {
+            return std::nullopt;
+        }
+        const size_t pos = offset + i;
+        hash[pos / 16] |= digit << (60 - pos % 16 * 4);
+    }
+    return hash;
+}
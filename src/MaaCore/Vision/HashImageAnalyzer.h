@@ -1,6 +1,8 @@
 #pragma once
 #include "AbstractImageAnalyzer.h"
 
+#include <optional>
+#include <string_view>
 #include <unordered_map>
 
 namespace asst
@@ -15,25 +17,29 @@ namespace asst
 
         void set_mask_range(int lower, int upper) noexcept;
         void set_mask_range(std::pair<int, int> mask_range) noexcept;
-        void set_hash_templates(std::unordered_map<std::string, std::string> hash_templates) noexcept;
+        // 十六进制的模板在这里一次性转好，识别时不用再解析字符串
+        void set_hash_templates(const std::unordered_map<std::string, std::string>& hash_templates);
         void set_need_split(bool need_split) noexcept;
         void set_need_bound(bool need_bound) noexcept;
 
         const std::vector<std::string>& get_min_dist_name() const noexcept;
-        const std::vector<std::string>& get_hash() const noexcept;
+        const std::vector<ImageHash>& get_hash() const noexcept;
 
-        static std::string s_hash(const cv::Mat& img);
-        static int hamming(std::string hash1, std::string hash2);
+        static ImageHash s_hash(const cv::Mat& img);
+        static int hamming(const ImageHash& hash1, const ImageHash& hash2) noexcept;
+        static std::string to_hex(const ImageHash& hash);
+        // 不足 64 位的前面补 0，有非十六进制字符或者太长的返回 nullopt
+        static std::optional<ImageHash> from_hex(std::string_view hex);
         static std::vector<cv::Mat> split_bin(const cv::Mat& bin);
         static cv::Mat bound_bin(const cv::Mat& bin);
 
     protected:
         std::pair<int, int> m_mask_range;
-        std::unordered_map<std::string, std::string> m_hash_templates;
+        std::unordered_map<std::string, ImageHash> m_hash_templates;
         bool m_need_split = false;
         bool m_need_bound = false;
 
-        std::vector<std::string> m_hash_result;
+        std::vector<ImageHash> m_hash_result;
         std::vector<std::string> m_min_dist_name;
     };
 }
@@ -86,6 +86,11 @@ void asst::MatchImageAnalyzer::set_log_tracing(bool enable) noexcept
     m_log_tracing = enable;
 }
 
+void asst::MatchImageAnalyzer::set_pyramid_level(int level) noexcept
+{
+    m_pyramid_level = level;
+}
+
 const asst::MatchRect& asst::MatchImageAnalyzer::get_result() const noexcept
 {
     return m_result;
@@ -97,6 +102,7 @@ void asst::MatchImageAnalyzer::set_task_info(MatchTaskInfo task_info) noexcept
     m_templ_name = std::move(task_info.templ_name);
     m_templ_thres = task_info.templ_threshold;
     m_use_cache = task_info.cache;
+    m_pyramid_level = task_info.pyramid_level;
 
     if (m_use_cache && !m_region_of_appeared.empty()) {
         m_roi = m_region_of_appeared;
@@ -115,23 +121,32 @@ bool asst::MatchImageAnalyzer::match_templ(const cv::Mat templ)
         return false;
     }
 
-    cv::Mat matched;
-    if (m_mask_range.first == 0 && m_mask_range.second == 0) {
-        cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED);
-    }
-    else {
-        cv::Mat mask;
-        cv::cvtColor(m_mask_with_src ? image_roi : templ, mask, cv::COLOR_BGR2GRAY);
-        cv::inRange(mask, m_mask_range.first, m_mask_range.second, mask);
-        if (m_mask_with_close) {
-            cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-            cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel);
+    cv::Mat mask;
+    if (m_mask_range.first != 0 || m_mask_range.second != 0) {
+        if (!m_mask_with_src && !m_templ_name.empty()) {
+            // 资源里的模板，掩码只用算一次
+            mask = TemplResource::get_instance().get_templ_mask(m_templ_name, m_mask_range, m_mask_with_close);
+        }
+        else {
+            cv::Mat gray;
+            cv::cvtColor(m_mask_with_src ? image_roi : templ, gray, cv::COLOR_BGR2GRAY);
+            mask = TemplResource::make_mask(gray, m_mask_range, m_mask_with_close);
         }
-        cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED, mask);
     }
+
     double min_val = 0.0, max_val = 0.0;
     cv::Point min_loc, max_loc;
-    cv::minMaxLoc(matched, &min_val, &max_val, &min_loc, &max_loc);
+    // mask_with_src 的掩码是按原图算的，没法跟着缩放，只走全分辨率
+    if (m_pyramid_level <= 0 || m_mask_with_src || !pyramid_match(image_roi, templ, mask, max_val, max_loc)) {
+        cv::Mat matched;
+        if (mask.empty()) {
+            cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED);
+        }
+        else {
+            cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED, mask);
+        }
+        cv::minMaxLoc(matched, &min_val, &max_val, &min_loc, &max_loc);
+    }
 
     Rect rect(max_loc.x + m_roi.x, max_loc.y + m_roi.y, templ.cols, templ.rows);
     if (max_val > 2.0) {
@@ -149,3 +164,82 @@ bool asst::MatchImageAnalyzer::match_templ(const cv::Mat templ)
         return false;
     }
 }
+
+bool asst::MatchImageAnalyzer::pyramid_match(const cv::Mat& image_roi, const cv::Mat& templ, const cv::Mat& mask,
+                                             double& max_val, cv::Point& max_loc) const
+{
+    static constexpr int MaxPyramidLevel = 2;
+    // 缩小后模板的短边至少要有这么多像素，不然粗匹配的结果没有参考价值
+    static constexpr int MinCoarseTemplSide = 8;
+    // 取粗匹配得分最高的几个候选，避免真正的位置在缩小后刚好被别的地方压过去
+    static constexpr int MaxCandidates = 3;
+    // 粗匹配分数比这个还低的不用精匹配了，肯定过不了阈值
+    static constexpr double CoarseScoreRatio = 0.6;
+
+    const int level = (std::min)(m_pyramid_level, MaxPyramidLevel);
+    const int scale = 1 << level;
+    if ((std::min)(templ.cols, templ.rows) / scale < MinCoarseTemplSide) {
+        return false;
+    }
+
+    auto downscale = [&](const cv::Mat& src, int interpolation) {
+        cv::Mat dst;
+        cv::resize(src, dst, cv::Size(src.cols / scale, src.rows / scale), 0, 0, interpolation);
+        return dst;
+    };
+    const cv::Mat coarse_image = downscale(image_roi, cv::INTER_AREA);
+    const cv::Mat coarse_templ = downscale(templ, cv::INTER_AREA);
+    cv::Mat coarse_matched;
+    if (mask.empty()) {
+        cv::matchTemplate(coarse_image, coarse_templ, coarse_matched, cv::TM_CCOEFF_NORMED);
+    }
+    else {
+        // 掩码缩放后不能出现中间值
+        cv::matchTemplate(coarse_image, coarse_templ, coarse_matched, cv::TM_CCOEFF_NORMED,
+                          downscale(mask, cv::INTER_NEAREST));
+    }
+    // 有掩码时可能算出 NaN / inf，minMaxLoc 会被带偏
+    cv::patchNaNs(coarse_matched, -1.0);
+    cv::threshold(coarse_matched, coarse_matched, 2.0, 0.0, cv::THRESH_TOZERO_INV);
+
+    max_val = 0.0;
+    max_loc = cv::Point();
+    // 粗匹配的一个像素对应原图 scale 个像素，再加上缩放时的取整误差
+    const int margin = scale + 1;
+    for (int i = 0; i < MaxCandidates; ++i) {
+        double coarse_val = 0.0;
+        cv::Point coarse_loc;
+        cv::minMaxLoc(coarse_matched, nullptr, &coarse_val, nullptr, &coarse_loc);
+        if (coarse_val < m_templ_thres * CoarseScoreRatio) {
+            break;
+        }
+        // 把这个候选附近抹掉，下一轮找别的地方
+        cv::Rect suppress(coarse_loc.x - coarse_templ.cols / 2, coarse_loc.y - coarse_templ.rows / 2,
+                          coarse_templ.cols, coarse_templ.rows);
+        coarse_matched(suppress & cv::Rect(0, 0, coarse_matched.cols, coarse_matched.rows)).setTo(-1.0);
+
+        // 在原图上候选位置附近开一个小窗口，窗口里的得分和全图匹配时同一位置的得分是一样的
+        const cv::Rect image_rect(0, 0, image_roi.cols, image_roi.rows);
+        cv::Rect window(coarse_loc.x * scale - margin, coarse_loc.y * scale - margin, templ.cols + 2 * margin,
+                        templ.rows + 2 * margin);
+        window &= image_rect;
+        if (window.width < templ.cols || window.height < templ.rows) {
+            continue;
+        }
+        cv::Mat fine_matched;
+        if (mask.empty()) {
+            cv::matchTemplate(image_roi(window), templ, fine_matched, cv::TM_CCOEFF_NORMED);
+        }
+        else {
+            cv::matchTemplate(image_roi(window), templ, fine_matched, cv::TM_CCOEFF_NORMED, mask);
+        }
+        double fine_val = 0.0;
+        cv::Point fine_loc;
+        cv::minMaxLoc(fine_matched, nullptr, &fine_val, nullptr, &fine_loc);
+        if (fine_val > max_val && fine_val < 2.0) {
+            max_val = fine_val;
+            max_loc = fine_loc + window.tl();
+        }
+    }
+    return true;
+}
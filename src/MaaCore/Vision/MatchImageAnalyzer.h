@@ -23,11 +23,16 @@ namespace asst
         void set_region_of_appeared(Rect region) noexcept;
         void set_mask_with_close(int with_close) noexcept;
         void set_log_tracing(bool enable) noexcept;
+        // 先在 1/2^level 分辨率上找候选，再回到原分辨率在候选附近精匹配，0 为不启用
+        void set_pyramid_level(int level) noexcept;
 
         const MatchRect& get_result() const noexcept;
 
     protected:
         virtual bool match_templ(const cv::Mat templ);
+        // 金字塔粗匹配 + 精匹配，模板太小缩不下去的话返回 false，调用方再走全分辨率匹配
+        bool pyramid_match(const cv::Mat& image_roi, const cv::Mat& templ, const cv::Mat& mask, double& max_val,
+                           cv::Point& max_loc) const;
         void set_task_info(MatchTaskInfo task_info) noexcept;
 
         std::string m_templ_name;
@@ -40,5 +45,6 @@ namespace asst
         bool m_mask_with_src = false;
         bool m_mask_with_close = false;
         bool m_log_tracing = true;
+        int m_pyramid_level = 0;
     };
 }
@@ -311,7 +311,7 @@ bool asst::BattleImageAnalyzer::kills_analyze()
 {
     OcrWithFlagTemplImageAnalyzer kills_analyzer(m_image);
     kills_analyzer.set_task_info("BattleKillsFlag", "BattleKills");
-    kills_analyzer.set_replace(Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_map);
+    kills_analyzer.set_replace(Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_rules);
 
     if (!kills_analyzer.analyze()) {
         return false;
@@ -376,7 +376,7 @@ bool asst::BattleImageAnalyzer::cost_analyze()
 {
     OcrWithPreprocessImageAnalyzer cost_analyzer(m_image);
     cost_analyzer.set_task_info("BattleCostData");
-    cost_analyzer.set_replace(Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_map);
+    cost_analyzer.set_replace(Task.get<OcrTaskInfo>("NumberOcrReplace")->replace_rules);
 
     if (!cost_analyzer.analyze()) {
         return false;
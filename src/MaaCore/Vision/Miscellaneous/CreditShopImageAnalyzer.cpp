@@ -71,7 +71,7 @@ bool asst::CreditShopImageAnalyzer::whether_to_buy_analyze()
 
         OcrImageAnalyzer ocr_analyzer(m_image);
         ocr_analyzer.set_roi(name_roi);
-        ocr_analyzer.set_replace(product_name_task_ptr->replace_map);
+        ocr_analyzer.set_replace(product_name_task_ptr->replace_rules);
         ocr_analyzer.set_required(m_shopping_list);
         if (ocr_analyzer.analyze()) {
             // 黑名单模式，有识别结果说明这个商品不买，直接跳过
@@ -1,15 +1,86 @@
 #include "ProcessTaskImageAnalyzer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <regex>
+#include <thread>
 #include <utility>
 
 #include "Config/TaskData.h"
 #include "Status.h"
 #include "Utils/Logger.hpp"
+#include "Utils/SingletonHolder.hpp"
 #include "Vision/MatchImageAnalyzer.h"
 #include "Vision/OcrImageAnalyzer.h"
 #include "Vision/OcrWithPreprocessImageAnalyzer.h"
 
+namespace asst
+{
+    // 所有实例共用的几个匹配线程。不用每帧都新开线程，开很多实例的时候线程数也有上限，
+    // matchTemplate 自己还会用 OpenCV 的 parallel_for，这里再多开只会抢核
+    class MatchWorkerPool final : public SingletonHolder<MatchWorkerPool>
+    {
+    public:
+        static constexpr size_t MaxWorkers = 4;
+
+        MatchWorkerPool()
+        {
+            const size_t count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, MaxWorkers);
+            for (size_t i = 0; i < count; ++i) {
+                m_threads.emplace_back(&MatchWorkerPool::work, this);
+            }
+        }
+        virtual ~MatchWorkerPool() override
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_exit = true;
+            }
+            m_cv.notify_all();
+            for (auto& thread : m_threads) {
+                thread.join();
+            }
+        }
+
+        size_t size() const noexcept { return m_threads.size(); }
+        void post(std::function<void()> func)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_queue.emplace_back(std::move(func));
+            }
+            m_cv.notify_one();
+        }
+
+    private:
+        void work()
+        {
+            while (true) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&]() { return m_exit || !m_queue.empty(); });
+                if (m_queue.empty()) {
+                    return;
+                }
+                auto func = std::move(m_queue.front());
+                m_queue.pop_front();
+                lock.unlock();
+                func();
+            }
+        }
+
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<std::function<void()>> m_queue;
+        bool m_exit = false;
+    };
+}
+
 asst::ProcessTaskImageAnalyzer::ProcessTaskImageAnalyzer(const cv::Mat& image, std::vector<std::string> tasks_name,
                                                          Assistant* inst)
     : AbstractImageAnalyzer(image, inst), m_tasks_name(std::move(tasks_name)), m_ocr_analyzer(nullptr),
@@ -118,6 +189,10 @@ bool asst::ProcessTaskImageAnalyzer::analyze()
     m_result = nullptr;
     m_result_rect = Rect();
 
+    if (m_parallel) {
+        return parallel_analyze();
+    }
+
     for (const std::string& task_name : m_tasks_name) {
         auto task_ptr = Task.get(task_name);
         // 可能有配置错误，导致不存在对应的任务
@@ -147,6 +222,166 @@ bool asst::ProcessTaskImageAnalyzer::analyze()
     return false;
 }
 
+bool asst::ProcessTaskImageAnalyzer::parallel_analyze()
+{
+    std::vector<std::shared_ptr<TaskInfo>> tasks;
+    tasks.reserve(m_tasks_name.size());
+    for (const std::string& task_name : m_tasks_name) {
+        auto task_ptr = Task.get(task_name);
+        // 可能有配置错误，导致不存在对应的任务
+        if (task_ptr == nullptr) {
+            Log.error("Invalid task", task_name);
+            continue;
+        }
+        tasks.emplace_back(std::move(task_ptr));
+    }
+
+    struct MatchJob
+    {
+        size_t priority = 0; // 在 tasks 里的下标，越小越优先
+        std::shared_ptr<MatchTaskInfo> task_ptr;
+        std::optional<Rect> region_of_appeared;
+        bool done = false;
+        bool matched = false;
+        Rect rect;
+        std::exception_ptr exception;
+    };
+    // Status 不是线程安全的，上次出现的位置在这里先读好，结果也回到这个线程再写
+    std::vector<MatchJob> jobs;
+    std::vector<size_t> job_of_task(tasks.size(), SIZE_MAX);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        if (tasks[i]->algorithm != AlgorithmType::MatchTemplate) {
+            continue;
+        }
+        auto match_task_ptr = std::dynamic_pointer_cast<MatchTaskInfo>(tasks[i]);
+        if (match_task_ptr->templ_threshold > 1.0) {
+            continue;
+        }
+        job_of_task[i] = jobs.size();
+        MatchJob job;
+        job.priority = i;
+        job.region_of_appeared = status()->get_rect(match_task_ptr->name);
+        job.task_ptr = std::move(match_task_ptr);
+        jobs.emplace_back(std::move(job));
+    }
+
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_cv;
+    size_t done_count = 0;       // 由 jobs_mutex 保护
+    size_t finished_workers = 0; // 由 jobs_mutex 保护
+    std::atomic_size_t next_job = 0;
+    // 已经确定的结果的优先级，排在它后面的候选还没开始的就不用跑了
+    std::atomic_size_t settled_priority = SIZE_MAX;
+
+    // 领一个还没开始的候选来匹配，都领完了返回 false
+    auto run_one = [&]() -> bool {
+        const size_t index = next_job++;
+        if (index >= jobs.size()) {
+            return false;
+        }
+        MatchJob& job = jobs[index];
+        bool matched = false;
+        Rect rect;
+        std::exception_ptr exception;
+        if (job.priority < settled_priority) {
+            try {
+                MatchImageAnalyzer analyzer(m_image);
+                analyzer.set_task_info(job.task_ptr);
+                if (job.region_of_appeared) {
+                    analyzer.set_region_of_appeared(*job.region_of_appeared);
+                }
+                matched = analyzer.analyze();
+                rect = analyzer.get_result().rect;
+            }
+            catch (...) {
+                exception = std::current_exception();
+            }
+        }
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            job.done = true;
+            job.matched = matched;
+            job.rect = rect;
+            job.exception = exception;
+            ++done_count;
+        }
+        jobs_cv.notify_all();
+        return true;
+    };
+    // 线程池是所有实例共用的，别的实例占着的时候当前线程等结果之前也自己领候选来跑，不会干等
+    auto& pool = MatchWorkerPool::get_instance();
+    const size_t workers_count = (std::min)(jobs.size(), pool.size());
+    for (size_t i = 0; i < workers_count; ++i) {
+        pool.post([&]() {
+            while (run_one()) {
+            }
+            // 拿着锁通知，settle 醒来之前这里已经不会再碰局部变量了
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            ++finished_workers;
+            jobs_cv.notify_all();
+        });
+    }
+    // 正在跑的匹配没法打断，返回前等它们跑完；还没开始的看到 settled_priority 就直接跳过。
+    // 投到线程池里的任务引用着这里的局部变量，要等它们都领不到候选了才能返回
+    auto settle = [&](size_t priority) {
+        settled_priority = priority;
+        while (run_one()) {
+        }
+        std::unique_lock<std::mutex> lock(jobs_mutex);
+        jobs_cv.wait(lock, [&]() { return done_count == jobs.size() && finished_workers == workers_count; });
+    };
+
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        const auto& task_ptr = tasks[i];
+        switch (task_ptr->algorithm) {
+        case AlgorithmType::JustReturn:
+            settle(i);
+            m_result = task_ptr;
+            return true;
+        case AlgorithmType::MatchTemplate: {
+            if (job_of_task[i] == SIZE_MAX) {
+                Log.trace(task_ptr->name, "'s threshold is",
+                          std::dynamic_pointer_cast<MatchTaskInfo>(task_ptr)->templ_threshold, ", just skip");
+                break;
+            }
+            MatchJob& job = jobs[job_of_task[i]];
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            while (!job.done) {
+                lock.unlock();
+                if (!run_one()) {
+                    lock.lock();
+                    jobs_cv.wait(lock, [&]() { return job.done; });
+                    break;
+                }
+                lock.lock();
+            }
+            lock.unlock();
+            if (job.exception) {
+                settle(i);
+                std::rethrow_exception(job.exception);
+            }
+            if (job.matched) {
+                settle(i);
+                m_result = task_ptr;
+                m_result_rect = job.rect;
+                status()->set_rect(task_ptr->name, m_result_rect);
+                return true;
+            }
+        } break;
+        case AlgorithmType::OcrDetect:
+            if (ocr_analyze(task_ptr)) {
+                settle(i);
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    settle(tasks.size());
+    return false;
+}
+
 void asst::ProcessTaskImageAnalyzer::set_image(const cv::Mat& image)
 {
     AbstractImageAnalyzer::set_image(image);
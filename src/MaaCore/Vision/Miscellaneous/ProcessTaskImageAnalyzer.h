@@ -24,6 +24,9 @@ namespace asst
         virtual void set_image(const cv::Mat& image) override;
 
         void set_tasks(std::vector<std::string> tasks_name);
+        // 并行模式：模板匹配的候选交给后台线程一起跑，OCR 还是在当前线程按顺序做。
+        // 结果和顺序执行一样，仍然是排在最前面的匹配上的那个
+        void set_parallel(bool parallel) noexcept { m_parallel = parallel; }
 
         std::shared_ptr<TaskInfo> get_result() const noexcept { return m_result; }
         const Rect& get_rect() const noexcept { return m_result_rect; }
@@ -36,6 +39,7 @@ namespace asst
         using AbstractImageAnalyzer::set_roi;
         bool match_analyze(const std::shared_ptr<TaskInfo>& task_ptr);
         bool ocr_analyze(const std::shared_ptr<TaskInfo>& task_ptr);
+        bool parallel_analyze();
         void reset() noexcept;
 
         std::unique_ptr<OcrImageAnalyzer> m_ocr_analyzer;
@@ -44,6 +48,7 @@ namespace asst
         std::vector<std::string> m_tasks_name;
         std::shared_ptr<TaskInfo> m_result = nullptr;
         Rect m_result_rect;
+        bool m_parallel = false;
         // std::vector<TextRect> m_ocr_cache;
     };
 }
@@ -1,6 +1,7 @@
 #include "MultiMatchImageAnalyzer.h"
 
 #include "Utils/Ranges.hpp"
+#include <unordered_map>
 #include <utility>
 
 #include "Utils/NoWarningCV.h"
@@ -114,38 +115,73 @@ bool asst::MultiMatchImageAnalyzer::multi_match_templ(const cv::Mat templ)
         cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED);
     }
     else {
-        cv::Mat mask;
-        cv::cvtColor(templ, mask, cv::COLOR_BGR2GRAY);
-        // cv::threshold(mask, mask, m_mask_range.first, 255, cv::THRESH_BINARY);
-        cv::inRange(mask, m_mask_range.first, m_mask_range.second, mask);
+        cv::Mat mask = TemplResource::get_instance().get_templ_mask(m_templ_name, m_mask_range, false);
         cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED, mask);
     }
 
+    // 绝大部分像素都过不了阈值，先整体挑出候选点，不用挨个 at 过去。
+    // inRange 是按 float 比的，下限放宽一点，下面再按原来的条件精确判断一次
+    cv::Mat hit_mask;
+    cv::inRange(matched, m_templ_thres - 1e-4, 2.0, hit_mask);
+    std::vector<cv::Point> hits;
+    cv::findNonZero(hit_mask, hits); // 按行优先的顺序，和逐像素遍历的顺序一样
+
     int mini_distance = (std::min)(templ.cols, templ.rows) / 2;
-    for (int i = 0; i != matched.rows; ++i) {
-        for (int j = 0; j != matched.cols; ++j) {
-            auto value = matched.at<float>(i, j);
-            if (m_templ_thres <= value && value < 2.0) {
-                Rect rect(j + m_roi.x, i + m_roi.y, templ.cols, templ.rows);
-                bool need_push = true;
-                // 如果有两个点离得太近，只取里面得分高的那个
-                // 一般相邻的都是刚刚push进去的，这里倒序快一点
-                for (auto& iter : ranges::reverse_view(m_result)) {
-                    if (std::abs(j + m_roi.x - iter.rect.x) < mini_distance &&
-                        std::abs(i + m_roi.y - iter.rect.y) < mini_distance) {
-                        if (iter.score < value) {
-                            iter.rect = rect;
-                            iter.score = value;
-                        } // else 这个点就放弃了
-                        need_push = false;
-                        break;
-                    }
+    // 结果按 mini_distance 分格子放，离得近的点只可能在相邻的九个格子里，不用把结果全扫一遍
+    const int cell_size = (std::max)(mini_distance, 1);
+    const int grid_cols = matched.cols / cell_size + 1;
+    const int grid_rows = matched.rows / cell_size + 1;
+    std::unordered_map<int, std::vector<size_t>> grid;
+    auto cell_of = [&](int x, int y) { return (y / cell_size) * grid_cols + x / cell_size; };
+
+    for (const cv::Point& point : hits) {
+        const int i = point.y;
+        const int j = point.x;
+        auto value = matched.at<float>(i, j);
+        if (!(m_templ_thres <= value && value < 2.0)) {
+            continue;
+        }
+        Rect rect(j + m_roi.x, i + m_roi.y, templ.cols, templ.rows);
+
+        // 如果有两个点离得太近，只取里面得分高的那个
+        // 和原来倒序扫结果一样，有多个的话取最后放进去的那个
+        size_t nearest = m_result.size();
+        for (int cy = i / cell_size - 1; cy <= i / cell_size + 1; ++cy) {
+            for (int cx = j / cell_size - 1; cx <= j / cell_size + 1; ++cx) {
+                if (cx < 0 || cy < 0 || cx >= grid_cols || cy >= grid_rows) {
+                    continue;
+                }
+                auto cell_iter = grid.find(cy * grid_cols + cx);
+                if (cell_iter == grid.end()) {
+                    continue;
                 }
-                if (need_push) {
-                    m_result.emplace_back(value, rect);
+                for (size_t index : cell_iter->second) {
+                    const Rect& exist = m_result[index].rect;
+                    if (std::abs(rect.x - exist.x) < mini_distance && std::abs(rect.y - exist.y) < mini_distance &&
+                        (nearest == m_result.size() || index > nearest)) {
+                        nearest = index;
+                    }
                 }
             }
         }
+
+        if (nearest == m_result.size()) {
+            grid[cell_of(j, i)].emplace_back(m_result.size());
+            m_result.emplace_back(value, rect);
+            continue;
+        }
+        auto& exist = m_result[nearest];
+        if (exist.score < value) {
+            // 点挪了位置，格子也要跟着换
+            const int old_cell = cell_of(exist.rect.x - m_roi.x, exist.rect.y - m_roi.y);
+            const int new_cell = cell_of(j, i);
+            if (old_cell != new_cell) {
+                std::erase(grid[old_cell], nearest);
+                grid[new_cell].emplace_back(nearest);
+            }
+            exist.rect = rect;
+            exist.score = value;
+        } // else 这个点就放弃了
     }
 
 #ifdef ASST_DEBUG
@@ -6,6 +6,7 @@
 #include "Config/Miscellaneous/OcrPack.h"
 #include "Config/TaskData.h"
 #include "Utils/Logger.hpp"
+#include "Utils/StringMisc.hpp"
 
 bool asst::OcrImageAnalyzer::analyze()
 {
@@ -17,8 +18,13 @@ bool asst::OcrImageAnalyzer::analyze()
 
     if (!m_replace.empty()) {
         TextRectProc text_replace = [&](TextRect& tr) -> bool {
-            for (const auto& [regex, new_str] : m_replace) {
-                tr.text = std::regex_replace(tr.text, std::regex(regex), new_str);
+            for (const auto& rule : m_replace) {
+                if (rule.regex) {
+                    tr.text = std::regex_replace(tr.text, *rule.regex, rule.replacement);
+                }
+                else {
+                    utils::string_replace_all_in_place(tr.text, rule.pattern, rule.replacement);
+                }
             }
             return true;
         };
@@ -96,7 +102,7 @@ void asst::OcrImageAnalyzer::set_required(std::vector<std::string> required) noe
     m_required = std::move(required);
 }
 
-void asst::OcrImageAnalyzer::set_replace(std::unordered_map<std::string, std::string> replace) noexcept
+void asst::OcrImageAnalyzer::set_replace(OcrReplaceRules replace) noexcept
 {
     m_replace = std::move(replace);
 }
@@ -105,7 +111,7 @@ void asst::OcrImageAnalyzer::set_task_info(OcrTaskInfo task_info) noexcept
 {
     m_required = std::move(task_info.text);
     m_full_match = task_info.full_match;
-    m_replace = std::move(task_info.replace_map);
+    m_replace = std::move(task_info.replace_rules);
     m_use_cache = task_info.cache;
     m_use_char_model = task_info.is_ascii;
 
@@ -2,7 +2,6 @@
 #include "AbstractImageAnalyzer.h"
 
 #include <functional>
-#include <unordered_map>
 #include <vector>
 
 #include "Common/AsstTypes.h"
@@ -25,7 +24,7 @@ namespace asst
         virtual void sort_result_by_required(); // 按传入的需求数组排序，传入的在前面结果接在前面
 
         void set_required(std::vector<std::string> required) noexcept;
-        void set_replace(std::unordered_map<std::string, std::string> replace) noexcept;
+        void set_replace(OcrReplaceRules replace) noexcept;
 
         virtual void set_task_info(std::shared_ptr<TaskInfo> task_ptr);
         virtual void set_task_info(const std::string& task_name);
@@ -44,7 +43,7 @@ namespace asst
         std::vector<TextRect> m_ocr_result;
         std::vector<std::string> m_required;
         bool m_full_match = false;
-        std::unordered_map<std::string, std::string> m_replace;
+        OcrReplaceRules m_replace;
         TextRectProc m_pred = nullptr;
         bool m_without_det = false;
         bool m_use_cache = false;
@@ -1684,5 +1684,20 @@ namespace MaaWpfGui
         /// Indicates whether the deployment should be paused.
         /// </summary>
         DeploymentWithPause = 3,
+
+        /// <summary>
+        /// Indicates whether screenshots are prefetched in a background thread.
+        /// </summary>
+        ScreencapPrefetch = 4,
+
+        /// <summary>
+        /// Indicates whether template candidates are matched in parallel.
+        /// </summary>
+        ParallelRecognition = 5,
+
+        /// <summary>
+        /// Indicates whether next candidates are reordered by hit statistics.
+        /// </summary>
+        AdaptiveTaskOrder = 6,
     }
 }
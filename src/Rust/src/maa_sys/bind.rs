@@ -118,6 +118,13 @@ extern "C" {
         buff_size: AsstSize,
     ) -> AsstSize;
 }
+extern "C" {
+    pub fn AsstGetLatencyStats(
+        handle: AsstHandle,
+        buff: *mut ::std::os::raw::c_char,
+        buff_size: AsstSize,
+    ) -> AsstSize;
+}
 extern "C" {
     pub fn AsstGetNullSize() -> AsstSize;
 }
@@ -0,0 +1,43 @@
+#!/bin/sh
+# 本机上的假 adb：shell / exec-out 直接在本机的 sh 里执行，用来测试 Controller 的常驻 shell 会话，不需要真的设备。
+#
+# 用法：把 config.json 里的 [Adb] 换成这个脚本的路径，或者直接跑 test_shell_session.sh
+#   FAKE_ADB_ECHO=1  模拟老版本 adb 给 shell 分配了 tty，输入会被回显到输出里，Controller 应该放弃会话
+#   FAKE_ADB_LOG     每次被调用时把参数追加写到这个文件里，用来确认命令有没有被执行两次
+
+if [ -n "$FAKE_ADB_LOG" ]; then
+    echo "$*" >>"$FAKE_ADB_LOG"
+fi
+
+if [ "$1" = "-s" ]; then
+    shift 2
+fi
+
+case "$1" in
+connect)
+    echo "connected to $2"
+    ;;
+devices)
+    printf 'List of devices attached\nfake\tdevice\n'
+    ;;
+kill-server | start-server | forward | reverse)
+    ;;
+shell | exec-out)
+    shift
+    if [ $# -gt 0 ]; then
+        exec sh -c "$*"
+    fi
+    if [ -z "$FAKE_ADB_ECHO" ]; then
+        exec sh
+    fi
+    # 一行一行地回显再执行，和 tty 的效果一样
+    while IFS= read -r line; do
+        printf '%s\n' "$line"
+        sh -c "$line"
+    done
+    ;;
+*)
+    echo "fake adb: unsupported command: $*" >&2
+    exit 1
+    ;;
+esac
@@ -0,0 +1,73 @@
+#!/bin/bash
+# 按 Controller::call_by_shell_session 的分帧方式和假 adb 对话，检查输出、退出码和结束标记的解析。
+# 用法：tools/FakeAdb/test_shell_session.sh，全部通过时退出码为 0
+
+set -u
+cd "$(dirname "$0")" || exit 1
+
+failed=0
+seq=0
+
+start_session() {
+    coproc SESSION { ./fake_adb.sh -s fake shell 2>&1; }
+}
+
+stop_session() {
+    exec {SESSION[1]}>&-
+    wait "$SESSION_PID" 2>/dev/null
+}
+
+# 和 Controller 一样：命令的 stdin 接 /dev/null，stderr 合并进 stdout，结束标记用拆开的引号拼出来
+call() {
+    seq=$((seq + 1))
+    local marker="###MAA_SHELL_END_${seq}###:"
+    printf '{ %s; } </dev/null 2>&1; echo "###MAA_SHELL_END_""%s###:$?"\n' "$1" "$seq" >&"${SESSION[1]}"
+
+    output=""
+    exit_ret=""
+    local line
+    while IFS= read -r -t 3 line <&"${SESSION[0]}"; do
+        if [[ "$line" == *"$marker"* ]]; then
+            output+="${line%%"$marker"*}"
+            exit_ret="${line##*"$marker"}"
+            return 0
+        fi
+        output+="$line"$'\n'
+    done
+    return 1
+}
+
+expect() {
+    local name="$1" want_output="$2" want_ret="$3"
+    if [[ "$output" != "$want_output" || "$exit_ret" != "$want_ret" ]]; then
+        echo "FAIL $name: output [$output] ret [$exit_ret], want [$want_output] ret [$want_ret]"
+        failed=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+start_session
+call 'echo "###MAA_SHELL_""READY###"' || echo "FAIL handshake: no end marker"
+expect "handshake" $'###MAA_SHELL_READY###\n' 0
+
+call 'echo hello' && expect "stdout" $'hello\n' 0
+call 'sh -c "echo oops >&2; exit 3"' && expect "stderr and exit code" $'oops\n' 3
+call 'false' && expect "nonzero without output" "" 1
+call 'printf abc' && expect "output without newline" "abc" 0
+call 'read x; echo "[${x:-}]"' && expect "stdin is /dev/null" $'[]\n' 0
+call 'printf "a\nb\n"' && expect "multi-line output" $'a\nb\n' 0
+stop_session
+
+# 老版本 adb 的 tty 回显：握手时能在输出里找到拆开的引号，Controller 据此放弃会话
+seq=0
+FAKE_ADB_ECHO=1 start_session
+if call 'echo "###MAA_SHELL_""READY###"' && [[ "$output" == *'MAA_SHELL_""READY'* ]]; then
+    echo "ok   echo detected"
+else
+    echo "FAIL echo detected: output [$output]"
+    failed=1
+fi
+stop_session
+
+exit $failed
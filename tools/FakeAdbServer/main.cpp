@@ -0,0 +1,291 @@
+// 本机上的假 adb server：按 smart socket 协议应答 Controller/AdbClient 的请求，shell / exec 直接在本机的 sh 里执行，
+// push 写到本机的目录里，用来测试 AdbClient，不需要真的设备和 adb。
+//
+// 用法：FakeAdbServer <端口> [--serial fake] [--root /tmp/fake_adb_root] [--no-shell-v2] [--drop 0]
+//   config.json 里的 adbServer 填 "127.0.0.1:<端口>"，连接地址填 --serial 的值
+//   --no-shell-v2  模拟 Android 7 以下的设备：shell,v2 请求回 FAIL，features 里也没有 shell_v2，
+//                  AdbClient 应该之后都不再走 shell v2
+//   --drop N       前 N 个 shell,v2 请求读完就断开不回应，模拟网络抖动，AdbClient 下次应该接着走 shell v2
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    struct Options
+    {
+        std::string serial = "fake";
+        std::filesystem::path root = "/tmp/fake_adb_root";
+        bool shell_v2 = true;
+        std::atomic_int drop = 0;
+    };
+
+    Options g_options;
+
+    bool send_all(int sock, std::string_view data)
+    {
+        while (!data.empty()) {
+            ssize_t sent = ::send(sock, data.data(), data.size(), MSG_NOSIGNAL);
+            if (sent <= 0) {
+                return false;
+            }
+            data.remove_prefix(static_cast<size_t>(sent));
+        }
+        return true;
+    }
+
+    bool recv_all(int sock, char* data, size_t len)
+    {
+        while (len > 0) {
+            ssize_t received = ::recv(sock, data, len, 0);
+            if (received <= 0) {
+                return false;
+            }
+            data += received;
+            len -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    bool read_request(int sock, std::string& request)
+    {
+        char len_hex[5] = { 0 };
+        if (!recv_all(sock, len_hex, 4)) {
+            return false;
+        }
+        request.assign(std::strtoul(len_hex, nullptr, 16), '\0');
+        return recv_all(sock, request.data(), request.size());
+    }
+
+    std::string hex_prefixed(std::string_view data)
+    {
+        char len_hex[5] = { 0 };
+        snprintf(len_hex, sizeof(len_hex), "%04zx", data.size());
+        return len_hex + std::string(data);
+    }
+
+    bool send_okay(int sock, std::string_view payload = {}, bool with_length = false)
+    {
+        return send_all(sock, "OKAY" + (with_length ? hex_prefixed(payload) : std::string(payload)));
+    }
+
+    bool send_fail(int sock, std::string_view reason)
+    {
+        return send_all(sock, "FAIL" + hex_prefixed(reason));
+    }
+
+    std::string le32(uint32_t value)
+    {
+        std::string ret;
+        for (int i = 0; i < 4; ++i) {
+            ret.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+        return ret;
+    }
+
+    // 在本机执行命令，每读到一段输出回调一次，返回退出码
+    template <typename OnOutput>
+    int run_command(const std::string& cmd, OnOutput&& on_output)
+    {
+        FILE* pipe = ::popen((cmd + " 2>&1 </dev/null").c_str(), "r");
+        if (!pipe) {
+            return 127;
+        }
+        char buffer[4096];
+        size_t len = 0;
+        while ((len = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+            on_output(std::string_view(buffer, len));
+        }
+        int status = ::pclose(pipe);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 255;
+    }
+
+    void handle_shell_v2(int sock, const std::string& cmd)
+    {
+        if (!g_options.shell_v2) {
+            // 老的 adbd 不认识这个服务，直接关掉流，adb server 回的就是 closed
+            send_fail(sock, "closed");
+            return;
+        }
+        if (g_options.drop.fetch_sub(1) > 0) {
+            std::cout << "drop shell,v2 request: " << cmd << std::endl;
+            return;
+        }
+        g_options.drop = 0;
+        if (!send_okay(sock)) {
+            return;
+        }
+        // 每个包是 1 字节 id + 4 字节小端长度 + 数据，1 为 stdout，3 为退出码
+        int exit_code = run_command(cmd, [&](std::string_view data) {
+            send_all(sock, std::string(1, '\1') + le32(static_cast<uint32_t>(data.size())) + std::string(data));
+        });
+        send_all(sock, std::string(1, '\3') + le32(1) + std::string(1, static_cast<char>(exit_code)));
+    }
+
+    void handle_raw(int sock, const std::string& cmd)
+    {
+        if (!send_okay(sock)) {
+            return;
+        }
+        run_command(cmd, [&](std::string_view data) { send_all(sock, data); });
+    }
+
+    void handle_sync(int sock)
+    {
+        if (!send_okay(sock)) {
+            return;
+        }
+        std::ofstream ofs;
+        std::filesystem::path target;
+        while (true) {
+            char header[8];
+            if (!recv_all(sock, header, sizeof(header))) {
+                return;
+            }
+            std::string_view id(header, 4);
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) {
+                value |= static_cast<uint32_t>(static_cast<unsigned char>(header[4 + i])) << (8 * i);
+            }
+            if (id == "QUIT") {
+                return;
+            }
+            if (id == "DONE") {
+                ofs.close();
+                std::cout << "pushed " << target << std::endl;
+                send_all(sock, "OKAY" + le32(0));
+                continue;
+            }
+            std::string data(value, '\0');
+            if (!recv_all(sock, data.data(), data.size())) {
+                return;
+            }
+            if (id == "SEND") {
+                // "<远端路径>,<mode>"，远端路径映射到 --root 下面
+                std::string remote = data.substr(0, data.rfind(','));
+                target = g_options.root / std::filesystem::path(remote).relative_path();
+                std::filesystem::create_directories(target.parent_path());
+                ofs.open(target, std::ios::out | std::ios::binary | std::ios::trunc);
+            }
+            else if (id == "DATA") {
+                ofs.write(data.data(), static_cast<std::streamsize>(data.size()));
+            }
+            else {
+                std::string msg = "unsupported sync request";
+                send_all(sock, "FAIL" + le32(static_cast<uint32_t>(msg.size())) + msg);
+                return;
+            }
+        }
+    }
+
+    void handle_connection(int sock)
+    {
+        std::string request;
+        const std::string host_serial = "host-serial:" + g_options.serial + ":";
+        while (read_request(sock, request)) {
+            std::cout << "request: " << request << std::endl;
+            if (request == "host:version") {
+                send_okay(sock, "0029", true);
+                break;
+            }
+            if (request.starts_with(host_serial)) {
+                std::string_view what = std::string_view(request).substr(host_serial.size());
+                if (what == "get-state") {
+                    send_okay(sock, "device", true);
+                }
+                else if (what == "features") {
+                    send_okay(sock, g_options.shell_v2 ? "shell_v2,cmd,stat_v2" : "cmd", true);
+                }
+                else {
+                    send_fail(sock, "unsupported request");
+                }
+                break;
+            }
+            if (request == "host:transport:" + g_options.serial) {
+                // 切到设备之后同一个连接上接着读下一个请求
+                send_okay(sock);
+                continue;
+            }
+            if (request.starts_with("host:transport:")) {
+                send_fail(sock, "device '" + request.substr(15) + "' not found");
+                break;
+            }
+            if (request.starts_with("shell,v2,raw:")) {
+                handle_shell_v2(sock, request.substr(13));
+            }
+            else if (request.starts_with("shell:")) {
+                handle_raw(sock, request.substr(6));
+            }
+            else if (request.starts_with("exec:")) {
+                handle_raw(sock, request.substr(5));
+            }
+            else if (request == "sync:") {
+                handle_sync(sock);
+            }
+            else {
+                send_fail(sock, "unknown service");
+            }
+            break;
+        }
+        ::close(sock);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <port> [--serial fake] [--root /tmp/fake_adb_root] [--no-shell-v2]"
+                  << " [--drop 0]" << std::endl;
+        return 1;
+    }
+    int port = std::atoi(argv[1]);
+    for (int i = 2; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--serial" && i + 1 < argc) {
+            g_options.serial = argv[++i];
+        }
+        else if (arg == "--root" && i + 1 < argc) {
+            g_options.root = argv[++i];
+        }
+        else if (arg == "--no-shell-v2") {
+            g_options.shell_v2 = false;
+        }
+        else if (arg == "--drop" && i + 1 < argc) {
+            g_options.drop = std::atoi(argv[++i]);
+        }
+    }
+
+    int server = ::socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    ::setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(server, 16) != 0) {
+        std::cerr << "failed to listen on 127.0.0.1:" << port << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    std::cout << "fake adb server listening on 127.0.0.1:" << port << ", serial " << g_options.serial << std::endl;
+
+    while (true) {
+        int sock = ::accept(server, nullptr, nullptr);
+        if (sock < 0) {
+            continue;
+        }
+        std::thread(handle_connection, sock).detach();
+    }
+}
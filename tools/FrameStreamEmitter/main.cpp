@@ -0,0 +1,250 @@
+// 流式截图方式（Stream）的参考 emitter：不截真正的屏幕，而是按固定帧率循环发送磁盘上的 PNG，用来测试和压测。
+// 设备上真正的 emitter 按 Controller/FrameStream.h 里的协议往 socket 写就行，Controller 断开后要自己退出。
+//
+// 用法：FrameStreamEmitter <端口> <PNG 文件或目录> [--fps 20] [--rgba] [--lz4]
+//   只监听 127.0.0.1，接一个连接，连接断开后退出，和设备上的 emitter 行为一致。
+//   在本机测的话把 config.json 里的命令换成类似下面这样，pushStreamEmitter 留空就不会去推设备上的 emitter：
+//     "pushStreamEmitter": "",
+//     "forwardStream": "echo 27183",
+//     "callStreamEmitter": "/path/to/FrameStreamEmitter 27183 /path/to/frames --lz4",
+//     "removeForwardStream": ""
+//   --rgba  按 RGBA 发，和 screencap 的原始数据一样，走 Controller 的 cvtColor；默认直接发 BGR
+//   --lz4   用 LZ4 block 格式压缩每一帧
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Controller/FrameStream.h"
+#include "Utils/NoWarningCV.h"
+
+namespace
+{
+    std::vector<cv::Mat> load_frames(const std::filesystem::path& path, bool rgba)
+    {
+        std::vector<std::filesystem::path> files;
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::directory_iterator(path)) {
+                if (entry.path().extension() == ".png") {
+                    files.emplace_back(entry.path());
+                }
+            }
+            std::sort(files.begin(), files.end());
+        }
+        else {
+            files.emplace_back(path);
+        }
+
+        std::vector<cv::Mat> frames;
+        for (const auto& file : files) {
+            cv::Mat image = cv::imread(file.string(), cv::IMREAD_COLOR);
+            if (image.empty()) {
+                std::cerr << "failed to read " << file << std::endl;
+                continue;
+            }
+            if (!frames.empty() && image.size() != frames.front().size()) {
+                std::cerr << "skip " << file << ", size mismatch" << std::endl;
+                continue;
+            }
+            if (rgba) {
+                cv::cvtColor(image, image, cv::COLOR_BGR2RGBA);
+            }
+            frames.emplace_back(std::move(image));
+        }
+        return frames;
+    }
+
+    // 最简单的贪心 LZ4 block 压缩：4 字节哈希找前面出现过的位置，能匹配就一直往后延伸。
+    // 压缩率不如官方实现，但格式是标准的，够测试用了
+    std::vector<uint8_t> lz4_compress(const uint8_t* src, size_t size)
+    {
+        constexpr size_t MinMatch = 4;
+        constexpr size_t LastLiterals = 5; // 最后 5 个字节必须是字面量
+        constexpr size_t MatchFindLimit = 12; // 最后一个匹配至少要在结尾前 12 个字节开始
+        constexpr int HashLog = 16;
+        constexpr uint32_t NoPosition = UINT32_MAX;
+
+        std::vector<uint8_t> out;
+        out.reserve(size / 2);
+
+        auto read32 = [&](size_t pos) {
+            uint32_t value = 0;
+            std::memcpy(&value, src + pos, sizeof(value));
+            return value;
+        };
+        auto write_length = [&](size_t length) {
+            for (; length >= 255; length -= 255) {
+                out.push_back(255);
+            }
+            out.push_back(static_cast<uint8_t>(length));
+        };
+        auto emit = [&](size_t literal_begin, size_t literal_end, size_t offset, size_t match_length) {
+            const size_t literal_length = literal_end - literal_begin;
+            const size_t match_code = match_length ? match_length - MinMatch : 0;
+            out.push_back(static_cast<uint8_t>((std::min<size_t>(literal_length, 15) << 4) |
+                                               std::min<size_t>(match_code, 15)));
+            if (literal_length >= 15) {
+                write_length(literal_length - 15);
+            }
+            out.insert(out.end(), src + literal_begin, src + literal_end);
+            if (match_length == 0) {
+                return;
+            }
+            out.push_back(static_cast<uint8_t>(offset & 0xff));
+            out.push_back(static_cast<uint8_t>(offset >> 8));
+            if (match_code >= 15) {
+                write_length(match_code - 15);
+            }
+        };
+
+        std::vector<uint32_t> table(size_t(1) << HashLog, NoPosition);
+        size_t anchor = 0;
+        size_t pos = 0;
+        while (pos + MatchFindLimit <= size) {
+            const uint32_t sequence = read32(pos);
+            const uint32_t hash = (sequence * 2654435761U) >> (32 - HashLog);
+            const uint32_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(pos);
+
+            if (candidate == NoPosition || pos - candidate > 65535 || read32(candidate) != sequence) {
+                ++pos;
+                continue;
+            }
+            size_t match_length = MinMatch;
+            const size_t match_limit = size - LastLiterals;
+            while (pos + match_length < match_limit && src[candidate + match_length] == src[pos + match_length]) {
+                ++match_length;
+            }
+            emit(anchor, pos, pos - candidate, match_length);
+            pos += match_length;
+            anchor = pos;
+        }
+        emit(anchor, size, 0, 0);
+        return out;
+    }
+
+    bool send_all(int sock, const void* data, size_t len)
+    {
+        auto* ptr = static_cast<const char*>(data);
+        while (len > 0) {
+            auto sent = ::send(sock, ptr, len, 0);
+            if (sent <= 0) {
+                return false;
+            }
+            ptr += sent;
+            len -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using namespace asst::frame_stream;
+
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <port> <png file or dir> [--fps N] [--rgba] [--lz4]" << std::endl;
+        return -1;
+    }
+    const auto port = static_cast<unsigned short>(std::stoi(argv[1]));
+    const std::filesystem::path frames_path = argv[2];
+    int fps = 20;
+    bool rgba = false;
+    bool lz4 = false;
+    for (int i = 3; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--fps" && i + 1 < argc) {
+            fps = (std::max)(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--rgba") {
+            rgba = true;
+        }
+        else if (arg == "--lz4") {
+            lz4 = true;
+        }
+    }
+
+    const auto frames = load_frames(frames_path, rgba);
+    if (frames.empty()) {
+        std::cerr << "no frame loaded" << std::endl;
+        return -1;
+    }
+
+    // Controller 断开后 send 会失败，别让 SIGPIPE 直接把进程带走
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listen_sock = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int reuse = 1;
+    ::setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(listen_sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listen_sock, 1) != 0) {
+        std::cerr << "failed to listen on port " << port << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    std::cout << "serving " << frames.size() << " frames (" << frames.front().cols << "x" << frames.front().rows
+              << ") on port " << port << ", fps " << fps << (lz4 ? ", lz4" : "") << std::endl;
+
+    int sock = ::accept(listen_sock, nullptr, nullptr);
+    ::close(listen_sock);
+    if (sock < 0) {
+        std::cerr << "accept failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    const StreamHeader stream_header {
+        .magic = Magic,
+        .version = ProtocolVersion,
+        .width = static_cast<uint32_t>(frames.front().cols),
+        .height = static_cast<uint32_t>(frames.front().rows),
+        .format = rgba ? PixelFormat::RGBA : PixelFormat::BGR,
+    };
+    if (!send_all(sock, &stream_header, sizeof(stream_header))) {
+        ::close(sock);
+        return -1;
+    }
+
+    const auto interval = std::chrono::microseconds(1'000'000 / fps);
+    auto next_time = std::chrono::steady_clock::now();
+    uint32_t seq = 0;
+    for (size_t index = 0;; index = (index + 1) % frames.size()) {
+        const cv::Mat& image = frames[index];
+        const size_t raw_size = image.total() * image.elemSize();
+
+        std::vector<uint8_t> compressed;
+        if (lz4) {
+            compressed = lz4_compress(image.data, raw_size);
+        }
+        const FrameHeader frame_header {
+            .seq = seq++,
+            .codec = lz4 ? Codec::LZ4 : Codec::Raw,
+            .payload_size = static_cast<uint32_t>(lz4 ? compressed.size() : raw_size),
+            .raw_size = static_cast<uint32_t>(raw_size),
+        };
+        if (!send_all(sock, &frame_header, sizeof(frame_header)) ||
+            !send_all(sock, lz4 ? compressed.data() : image.data, frame_header.payload_size)) {
+            break;
+        }
+
+        next_time += interval;
+        std::this_thread::sleep_until(next_time);
+    }
+
+    std::cout << "client disconnected after " << seq << " frames" << std::endl;
+    ::close(sock);
+    return 0;
+}
@@ -0,0 +1,192 @@
+// 共享内存截图方式（SharedMemory）的参考 agent：不截真正的屏幕，而是循环播放磁盘上的 PNG，用来测试和压测。
+// 真正的 agent（比如模拟器插件）按同样的布局写 Controller/ShmFrameRing.h 里的环形缓冲区就行。
+//
+// 用法：ShmFrameAgent <共享内存名> <PNG 文件或目录> [--fps 30] [--slots 3] [--rgba] [--on-demand]
+//   共享内存名要和 config.json 里 screencapSharedMemory 替换后的一致，比如 /maa_screencap_127.0.0.1:5555
+//   --rgba       按 RGBA 写，和 screencap 的原始数据一样，走 Controller 的 cvtColor；默认直接写 BGR
+//   --on-demand  不推流，Controller 要图的时候才写一帧
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "Controller/ShmFrameRing.h"
+#include "Utils/NoWarningCV.h"
+
+namespace
+{
+    std::atomic_bool g_running = true;
+
+    void on_signal(int)
+    {
+        g_running = false;
+    }
+
+    std::vector<cv::Mat> load_frames(const std::filesystem::path& path, bool rgba)
+    {
+        std::vector<std::filesystem::path> files;
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::directory_iterator(path)) {
+                if (entry.path().extension() == ".png") {
+                    files.emplace_back(entry.path());
+                }
+            }
+            std::sort(files.begin(), files.end());
+        }
+        else {
+            files.emplace_back(path);
+        }
+
+        std::vector<cv::Mat> frames;
+        for (const auto& file : files) {
+            cv::Mat image = cv::imread(file.string(), cv::IMREAD_COLOR);
+            if (image.empty()) {
+                std::cerr << "failed to read " << file << std::endl;
+                continue;
+            }
+            if (!frames.empty() && image.size() != frames.front().size()) {
+                std::cerr << "skip " << file << ", size mismatch" << std::endl;
+                continue;
+            }
+            if (rgba) {
+                cv::cvtColor(image, image, cv::COLOR_BGR2RGBA);
+            }
+            frames.emplace_back(std::move(image));
+        }
+        return frames;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using namespace asst::shm_frame;
+
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0]
+                  << " <shm name> <png file or dir> [--fps N] [--slots N] [--rgba] [--on-demand]" << std::endl;
+        return -1;
+    }
+    const std::string shm_name = argv[1];
+    const std::filesystem::path frames_path = argv[2];
+    int fps = 30;
+    uint32_t slot_count = 3;
+    bool rgba = false;
+    bool on_demand = false;
+    for (int i = 3; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--fps" && i + 1 < argc) {
+            fps = (std::max)(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--slots" && i + 1 < argc) {
+            slot_count = static_cast<uint32_t>((std::max)(2, std::stoi(argv[++i])));
+        }
+        else if (arg == "--rgba") {
+            rgba = true;
+        }
+        else if (arg == "--on-demand") {
+            on_demand = true;
+        }
+    }
+
+    const auto frames = load_frames(frames_path, rgba);
+    if (frames.empty()) {
+        std::cerr << "no frame loaded" << std::endl;
+        return -1;
+    }
+    const auto width = static_cast<uint32_t>(frames.front().cols);
+    const auto height = static_cast<uint32_t>(frames.front().rows);
+    const PixelFormat format = rgba ? PixelFormat::RGBA : PixelFormat::BGR;
+    const uint64_t slot_size = aligned_slot_size(width, height, format);
+    const size_t size = total_size(slot_count, slot_size);
+
+    // 上次没清理干净的先删掉，已经映射着旧共享内存的 Controller 等不到新帧会自己重新打开
+    ::shm_unlink(shm_name.c_str());
+    int fd = ::shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        std::cerr << "failed to create shared memory " << shm_name << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "mmap failed: " << strerror(errno) << std::endl;
+        ::shm_unlink(shm_name.c_str());
+        return -1;
+    }
+
+    auto* base = static_cast<uint8_t*>(data);
+    auto* header = new (base) RingHeader {};
+    auto* slots = reinterpret_cast<SlotHeader*>(base + sizeof(RingHeader));
+    for (uint32_t i = 0; i < slot_count; ++i) {
+        new (slots + i) SlotHeader {};
+    }
+    header->version = LayoutVersion;
+    header->slot_count = slot_count;
+    header->width = width;
+    header->height = height;
+    header->format = format;
+    header->slot_size = slot_size;
+    // magic 最后写，Controller 看到 magic 对了才会用
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = Magic;
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::cout << "serving " << frames.size() << " frames (" << width << "x" << height << ") on " << shm_name
+              << (on_demand ? ", on demand" : ", fps " + std::to_string(fps)) << std::endl;
+
+    auto publish = [&](const cv::Mat& image) {
+        uint32_t frame = header->published.load(std::memory_order_relaxed) + 1;
+        uint32_t index = frame % slot_count;
+        auto& slot = slots[index];
+
+        // seqlock：写之前改成奇数，写完改回偶数，Controller 读的过程中 seq 变了就会重读
+        uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(base + slot_offset(slot_count, slot_size, index), image.data, image.total() * image.elemSize());
+        slot.frame = frame;
+        slot.seq.store(seq + 2, std::memory_order_release);
+
+        header->published.store(frame, std::memory_order_release);
+        wake_all(header->published);
+    };
+
+    const auto interval = std::chrono::microseconds(1'000'000 / fps);
+    auto next_time = std::chrono::steady_clock::now();
+    uint32_t requested = header->requested.load();
+    size_t index = 0;
+    while (g_running) {
+        if (on_demand) {
+            // 定时醒一下看看是不是该退出了
+            using namespace std::chrono_literals;
+            if (!wait_changed(header->requested, requested, std::chrono::steady_clock::now() + 200ms)) {
+                continue;
+            }
+            requested = header->requested.load();
+        }
+        else {
+            next_time += interval;
+            std::this_thread::sleep_until(next_time);
+        }
+        publish(frames[index]);
+        index = (index + 1) % frames.size();
+    }
+
+    ::munmap(data, size);
+    ::shm_unlink(shm_name.c_str());
+    return 0;
+}